@@ -0,0 +1,321 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "../render/render_pool.h"
+#include "../shader/ray_march_test_shader.h"
+#include "../shader/raymarch/instancing.h"
+#include "../shader/raymarch/warp.h"
+#include "../demo_scene.h"
+
+/**
+ * Test shader that makes the raycasts of a ray_march_shader available to the benchmarks
+ */
+class bench_shader : public ray_march_test_shader {
+public:
+    using ray_march_test_shader::ray_march_test_shader;
+
+    /**
+     * Casts a single ray with the marcher selected in the settings
+     */
+    raycast_info cast(const ray& r) const {
+        return config.segment_tracing ? segment_raycast(r, distThreshold) : raycast(r, distThreshold);
+    }
+
+    /**
+     * Casts FRAG_PACKET_SIZE rays as a packet
+     */
+    void cast_packet(const ray rays[], raycast_info out_infos[]) const {
+        raycast_packet(rays, distThreshold, out_infos);
+    }
+};
+
+/**
+ * @return Points spread uniformly over a cube around the origin, the same for every run
+ */
+static std::vector<vec3> sample_points(size_t count, double extent) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> coord(-extent, extent);
+    std::vector<vec3> points(count);
+    for (auto& p : points) p = vec3(coord(rng), coord(rng), coord(rng));
+    return points;
+}
+
+static void bench_vec3(bench_runner& runner) {
+    const auto a = sample_points(1024, 2.0), b = sample_points(1024, 3.0);
+    const long n = static_cast<long>(a.size());
+
+    runner.run_fast("micro", "vec3/add", n, [&]() {
+        for (size_t i = 0; i < a.size(); i++) do_not_optimize(a[i] + b[i]);
+    });
+    runner.run_fast("micro", "vec3/dot", n, [&]() {
+        for (size_t i = 0; i < a.size(); i++) do_not_optimize(dot(a[i], b[i]));
+    });
+    runner.run_fast("micro", "vec3/cross", n, [&]() {
+        for (size_t i = 0; i < a.size(); i++) do_not_optimize(cross(a[i], b[i]));
+    });
+    runner.run_fast("micro", "vec3/length", n, [&]() {
+        for (size_t i = 0; i < a.size(); i++) do_not_optimize(a[i].length());
+    });
+    runner.run_fast("micro", "vec3/unit_vector", n, [&]() {
+        for (size_t i = 0; i < a.size(); i++) do_not_optimize(unit_vector(a[i]));
+    });
+    runner.run_fast("micro", "vec3x4/length", n, [&]() {
+        for (size_t i = 0; i + 4 <= a.size(); i += 4) {
+            do_not_optimize(vec3x4(a[i], a[i + 1], a[i + 2], a[i + 3]).length());
+        }
+    });
+}
+
+/**
+ * Benchmarks sdf(), sdf_x4() and normal() of one object over the same set of points
+ */
+static void bench_object(bench_runner& runner, const std::string& name, const sdf_object* obj) {
+    const auto points = sample_points(1024, 2.0);
+    const long n = static_cast<long>(points.size());
+
+    runner.run_fast("micro", "sdf/" + name, n, [&]() {
+        for (const auto& p : points) do_not_optimize(obj->sdf(p));
+    });
+    runner.run_fast("micro", "sdf_x4/" + name, n, [&]() {
+        for (size_t i = 0; i + 4 <= points.size(); i += 4) {
+            do_not_optimize(obj->sdf_x4(vec3x4(points[i], points[i + 1], points[i + 2], points[i + 3])));
+        }
+    });
+    runner.run_fast("micro", "normal/" + name, n, [&]() {
+        for (const auto& p : points) do_not_optimize(obj->normal(p));
+    });
+}
+
+static void bench_objects(bench_runner& runner) {
+    scene_builder b;
+    bench_object(runner, "sphere", b.make<sdf_sphere>(vec3(0.1, 0, 0), 0.5));
+    bench_object(runner, "cylinder", b.make<sdf_cylinder>(vec3(0, 0.1, 0), 0.8, 0.3));
+    bench_object(runner, "capsule", b.make<sdf_capsule>(vec3(0, -0.5, 0), vec3(0.2, 0.5, 0), 0.2));
+    bench_object(runner, "ground_plane", b.make<sdf_ground_plane>(-1.0));
+    bench_object(runner, "padded_diff", b.make<sdf_padded>(
+            b.make<sdf_diff>(vec3(), b.make<sdf_sphere>(vec3(), 0.3), b.make<sdf_sphere>(vec3(-0.13, 0.2, 0.1), 0.4)),
+            0.1));
+    bench_object(runner, "smooth_union", b.make<sdf_smooth_union>(
+            vec3(), b.make<sdf_sphere>(vec3(-0.3, 0, 0), 0.4), b.make<sdf_capsule>(vec3(0, -0.5, 0), vec3(0, 0.5, 0), 0.2),
+            0.2));
+    bench_object(runner, "twist", b.make<sdf_twist>(
+            b.make<sdf_capsule>(vec3(0.3, -0.8, 0), vec3(0.3, 0.8, 0), 0.15), 2.0));
+    bench_object(runner, "repeat", b.make<sdf_repeat>(b.make<sdf_sphere>(vec3(), 0.2), vec3(1, 0, 1)));
+    bench_object(runner, "mirror", b.make<sdf_mirror>(b.make<sdf_sphere>(vec3(0.5, 0, 0.5), 0.2), vec3(1, 0, 1)));
+    bench_object(runner, "polar", b.make<sdf_polar>(b.make<sdf_sphere>(vec3(1, 0, 0), 0.2), 12));
+    std::vector<vec3> positions;
+    for (int i = 0; i < 64; i++) positions.emplace_back(0.5 * (i % 8) - 1.75, 0, 0.5 * (i / 8) - 1.75);
+    bench_object(runner, "instances", b.make<sdf_instances>(b.make<sdf_sphere>(vec3(), 0.2), positions));
+}
+
+/**
+ * @return Scene with a single object tree of 'depth' nested unions and differences around the origin
+ */
+static std::shared_ptr<const scene> deep_csg_scene(int depth) {
+    scene_builder b;
+    init_lights(b);
+    sdf_object* node = b.make<sdf_sphere>(vec3(), 0.5);
+    for (int i = 0; i < depth; i++) {
+        double angle = i * 2.4;
+        vec3 offset(0.45 * std::cos(angle), 0.1 * (i % 5) - 0.2, 0.45 * std::sin(angle));
+        if (i % 2 == 0) {
+            node = b.make<sdf_union>(vec3(), node, b.make<sdf_sphere>(offset, 0.12));
+        } else {
+            node = b.make<sdf_diff>(vec3(), node, b.make<sdf_sphere>(offset * 1.3, 0.1));
+        }
+    }
+    b += node;
+    return b.freeze();
+}
+
+/**
+ * @return Scene with an endless grid of spheres on the ground plane, built from a single sdf_repeat node
+ */
+static std::shared_ptr<const scene> instanced_scene() {
+    scene_builder b;
+    init_lights(b);
+    b += b.make<sdf_repeat>(b.make<sdf_sphere>(vec3(0, -0.75, 0), 0.25), vec3(1, 0, 1));
+    b += b.make<sdf_ground_plane>(-1.0);
+    return b.freeze();
+}
+
+/**
+ * Benchmarks single raycasts and ray packets with both marchers
+ * @param name Name of the ray setup
+ * @param scn Scene to cast into
+ * @param r Ray to be cast. The rays of the packet are spread slightly around it
+ */
+static void bench_ray(bench_runner& runner, const std::string& name, const std::shared_ptr<const scene>& scn,
+                      const ray& r) {
+    bench_shader shader(scn);
+    runner.run_fast("ray", name + "/sphere", 1, [&]() { do_not_optimize(shader.cast(r).travel); });
+
+    ray rays[FRAG_PACKET_SIZE];
+    raycast_info infos[FRAG_PACKET_SIZE];
+    for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+        rays[i] = ray(r.origin(), unit_vector(r.direction() + vec3(0.0005 * i, 0.0003 * i, 0)));
+    }
+    runner.run_fast("ray", name + "/packet", FRAG_PACKET_SIZE, [&]() {
+        shader.cast_packet(rays, infos);
+        do_not_optimize(infos[0].travel);
+    });
+
+    shader.settings().segment_tracing = true;
+    runner.run_fast("ray", name + "/segment", 1, [&]() { do_not_optimize(shader.cast(r).travel); });
+}
+
+static void bench_rays(bench_runner& runner) {
+    scene_builder b;
+    init_scene(b);
+    auto demo = b.freeze();
+
+    bench_ray(runner, "open_sky", demo, ray(vec3(0, 0, 0), unit_vector(vec3(0.1, 1, -0.3))));
+    bench_ray(runner, "grazing_ground", demo, ray(vec3(1, -0.95, 0), unit_vector(vec3(0.05, -0.004, -1))));
+    bench_ray(runner, "deep_csg", deep_csg_scene(24), ray(vec3(0.05, 0.02, 3), vec3(0, 0, -1)));
+    bench_ray(runner, "instanced", instanced_scene(), ray(vec3(0.3, 0, 0), unit_vector(vec3(0.05, -0.1, -1))));
+}
+
+static void bench_frames(bench_runner& runner) {
+    scene_builder b;
+    init_scene(b);
+    auto demo = b.freeze();
+    auto instanced = instanced_scene();
+
+    std::vector<int> thread_counts = {1, 2};
+    int hardware = static_cast<int>(std::thread::hardware_concurrency());
+    if (hardware > 2) thread_counts.push_back(hardware);
+
+    for (int threads : thread_counts) {
+        render_pool pool(threads);
+        for (int height : {180, 360, 720}) {
+            int width = height * 16 / 9;
+            std::vector<unsigned char> image(static_cast<size_t>(width) * height * 3);
+            ray_march_test_shader shader(demo);
+            std::string name = "test_shader/" + std::to_string(width) + "x" + std::to_string(height) + "/threads_"
+                    + std::to_string(threads);
+            runner.run_slow("frame", name, [&]() { pool.submit(&shader, image.data(), width, height).wait(); });
+        }
+
+        // Instancing nodes are evaluated for whole ray packets, which a fallback to single points would slow down
+        const int width = 640, height = 360;
+        std::vector<unsigned char> image(static_cast<size_t>(width) * height * 3);
+        ray_march_test_shader shader(instanced);
+        std::string name = "instanced/" + std::to_string(width) + "x" + std::to_string(height) + "/threads_"
+                + std::to_string(threads);
+        runner.run_slow("frame", name, [&]() { pool.submit(&shader, image.data(), width, height).wait(); });
+    }
+}
+
+/**
+ * Benchmarks baking the distance cache and the shadow maps of the demo scene, and frames rendered with both
+ */
+static void bench_baked(bench_runner& runner) {
+    scene_builder b;
+    init_scene(b);
+    auto demo = b.freeze();
+
+    // Everything the camera sees up to the cylinder in the back, the sky above it stays unbaked
+    const aabb region(point3(-5, -1.2, -11), point3(4, 2, 0.5));
+    distance_cache::settings cache_settings;
+    cache_settings.region = region;
+    shadow_map::settings shadow_settings;
+    shadow_settings.region = region;
+
+    ray_march_test_shader shader(demo);
+    runner.run_slow("bake", "distance_cache", [&]() { shader.bake_distance_cache(cache_settings); });
+    runner.run_slow("bake", "shadow_maps", [&]() { shader.bake_shadow_maps(shadow_settings); });
+
+    render_pool pool;
+    bool baked = false;
+    for (int height : {360, 720}) {
+        int width = height * 16 / 9;
+        std::string name = "test_shader_baked/" + std::to_string(width) + "x" + std::to_string(height) + "/threads_"
+                + std::to_string(pool.worker_count());
+        if (!runner.selected("frame", name)) continue;
+
+        if (!baked) {
+            // The shadow maps are baked after the distance cache, which speeds up their rays
+            shader.bake_distance_cache(cache_settings);
+            shader.bake_shadow_maps(shadow_settings);
+            baked = true;
+        }
+        std::vector<unsigned char> image(static_cast<size_t>(width) * height * 3);
+        runner.run_slow("frame", name, [&]() { pool.submit(&shader, image.data(), width, height).wait(); });
+    }
+}
+
+static void print_usage() {
+    std::cout << "Usage: cpu_raymarcher_bench [--json FILE] [--filter TEXT] [--repetitions N] [--quick]\n"
+                 "  --json FILE       Write the results as JSON to FILE (default: bench_results.json)\n"
+                 "  --filter TEXT     Only run benchmarks whose group/name contains TEXT, e.g. 'ray/' or 'sdf/'\n"
+                 "  --repetitions N   Measured repetitions of fast benchmarks\n"
+                 "  --quick           Fewer and shorter repetitions, for a quick check\n";
+}
+
+int main(int argc, char** argv) {
+    bench_runner::settings s;
+    std::string json_path = "bench_results.json";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            s.filter = argv[++i];
+        } else if (arg == "--repetitions" && i + 1 < argc) {
+            s.repetitions = max(1, std::atoi(argv[++i]));
+        } else if (arg == "--quick") {
+            s.warmup = 1;
+            s.repetitions = 5;
+            s.slow_repetitions = 3;
+            s.min_time = 0.002;
+        } else {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+#ifndef __OPTIMIZE__
+    std::cerr << "Warning: benchmarks were built without optimizations, configure with -DCMAKE_BUILD_TYPE=Release"
+              << std::endl;
+#endif
+
+    bench_runner runner(s);
+    bench_vec3(runner);
+    bench_objects(runner);
+    bench_rays(runner);
+    bench_frames(runner);
+    bench_baked(runner);
+    runner.print_table(std::cout);
+
+#ifdef __OPTIMIZE__
+    const char* optimized = "true";
+#else
+    const char* optimized = "false";
+#endif
+#if defined(CPU_RAYMARCHER_SIMD_AVX)
+    const char* simd = "\"avx\"";
+#elif defined(CPU_RAYMARCHER_SIMD_SSE2)
+    const char* simd = "\"sse2\"";
+#else
+    const char* simd = "\"scalar\"";
+#endif
+    std::ofstream json(json_path);
+    runner.write_json(json, {{"compiler", std::string("\"") + __VERSION__ + "\""},
+                             {"optimized", optimized},
+                             {"simd", simd},
+                             {"hardware_threads", std::to_string(std::thread::hardware_concurrency())},
+                             {"warmup", std::to_string(s.warmup)},
+                             {"min_time_s", std::to_string(s.min_time)}});
+    if (!json) {
+        std::cerr << "Could not write " << json_path << std::endl;
+        return 1;
+    }
+    std::cout << "Results written to " << json_path << std::endl;
+}
@@ -0,0 +1,224 @@
+#ifndef CPU_RAYMARCHER_BENCHMARK_H
+#define CPU_RAYMARCHER_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Keeps the compiler from optimizing away the computation of a value that is otherwise unused
+ */
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Timing statistics of one benchmark
+ */
+struct bench_result {
+    std::string group;
+    std::string name;
+
+    /**
+     * Unit of the samples, e.g. "ns" per operation or "ms" per frame
+     */
+    std::string unit;
+
+    int warmup = 0;
+    int repetitions = 0;
+
+    /**
+     * Number of operations timed together in each repetition; samples are per operation
+     */
+    long operations = 0;
+
+    double min = 0, p10 = 0, median = 0, mean = 0, p90 = 0, p99 = 0, max = 0, stddev = 0;
+};
+
+/**
+ * Runs benchmarks with warm-up and repeated measurements and collects their statistics
+ */
+class bench_runner {
+public:
+    struct settings {
+        /**
+         * Unmeasured runs before the measurement starts
+         */
+        int warmup = 3;
+
+        /**
+         * Measured runs of every benchmark
+         */
+        int repetitions = 21;
+
+        /**
+         * Measured runs of benchmarks that are slow on their own, like whole frames
+         */
+        int slow_repetitions = 7;
+
+        /**
+         * Minimum duration of a repetition of a fast benchmark in seconds. Fast operations are repeated within a
+         * repetition until it takes at least this long
+         */
+        double min_time = 0.01;
+
+        /**
+         * Only benchmarks whose "group/name" contains this string are run
+         */
+        std::string filter;
+    };
+
+    explicit bench_runner(settings _config) : config(std::move(_config)) {}
+
+    /**
+     * Measures a fast operation. The operation is run in batches whose size is calibrated so that a repetition
+     * takes at least settings::min_time
+     * @param group Group of the benchmark, e.g. "micro"
+     * @param name Name of the benchmark within its group
+     * @param ops_per_call Number of operations one call of fn performs
+     * @param fn Performs ops_per_call operations
+     */
+    template<typename F>
+    void run_fast(const std::string& group, const std::string& name, long ops_per_call, F fn) {
+        if (!selected(group, name)) return;
+
+        long calls = 1;
+        while (true) {
+            double t = time_calls(fn, calls);
+            if (t >= config.min_time || calls >= (1L << 30)) break;
+            calls = t > 0 ? std::max(calls * 2, static_cast<long>(calls * config.min_time / t * 1.2)) : calls * 16;
+        }
+
+        for (int i = 0; i < config.warmup; i++) time_calls(fn, calls);
+        std::vector<double> samples;
+        for (int i = 0; i < config.repetitions; i++) {
+            samples.push_back(time_calls(fn, calls) * 1e9 / (static_cast<double>(calls) * ops_per_call));
+        }
+        record(group, name, "ns", config.warmup, calls * ops_per_call, samples);
+    }
+
+    /**
+     * Measures a slow operation, one run per repetition
+     * @param group Group of the benchmark, e.g. "frame"
+     * @param name Name of the benchmark within its group
+     * @param fn Performs the operation once
+     */
+    template<typename F>
+    void run_slow(const std::string& group, const std::string& name, F fn) {
+        if (!selected(group, name)) return;
+
+        int warmup = std::min(config.warmup, 1);
+        for (int i = 0; i < warmup; i++) time_calls(fn, 1);
+        std::vector<double> samples;
+        for (int i = 0; i < config.slow_repetitions; i++) samples.push_back(time_calls(fn, 1) * 1e3);
+        record(group, name, "ms", warmup, 1, samples);
+    }
+
+    /**
+     * @return Whether a benchmark passes the filter, e.g. to skip its setup when it isn't run
+     */
+    bool selected(const std::string& group, const std::string& name) const {
+        return config.filter.empty() || (group + "/" + name).find(config.filter) != std::string::npos;
+    }
+
+    const std::vector<bench_result>& results() const { return all; }
+
+    /**
+     * Writes all results as a human-readable table
+     */
+    void print_table(std::ostream& out) const {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-44s %12s %12s %12s %12s\n", "benchmark", "median", "p10", "p90", "p99");
+        out << line;
+        for (const auto& r : all) {
+            std::string name = r.group + "/" + r.name;
+            std::snprintf(line, sizeof(line), "%-44s %9.3f %-2s %9.3f %-2s %9.3f %-2s %9.3f %-2s\n", name.c_str(),
+                          r.median, r.unit.c_str(), r.p10, r.unit.c_str(), r.p90, r.unit.c_str(), r.p99,
+                          r.unit.c_str());
+            out << line;
+        }
+    }
+
+    /**
+     * Writes all results as a JSON document
+     * @param out Output stream
+     * @param context Additional key/value pairs describing the run, written into the "context" object. Values are
+     * written verbatim, so strings must be quoted already
+     */
+    void write_json(std::ostream& out, const std::vector<std::pair<std::string, std::string>>& context) const {
+        out << "{\n  \"context\": {";
+        for (size_t i = 0; i < context.size(); i++) {
+            out << (i > 0 ? "," : "") << "\n    \"" << context[i].first << "\": " << context[i].second;
+        }
+        out << "\n  },\n  \"benchmarks\": [";
+        for (size_t i = 0; i < all.size(); i++) {
+            const auto& r = all[i];
+            out << (i > 0 ? "," : "") << "\n    {\"group\": \"" << r.group << "\", \"name\": \"" << r.name
+                << "\", \"unit\": \"" << r.unit << "\", \"warmup\": " << r.warmup << ", \"repetitions\": "
+                << r.repetitions << ", \"operations\": " << r.operations << ", \"min\": " << r.min
+                << ", \"p10\": " << r.p10 << ", \"median\": " << r.median << ", \"mean\": " << r.mean
+                << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99 << ", \"max\": " << r.max
+                << ", \"stddev\": " << r.stddev << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+private:
+    /**
+     * @return Seconds taken by 'calls' calls of fn
+     */
+    template<typename F>
+    static double time_calls(F& fn, long calls) {
+        auto begin = std::chrono::steady_clock::now();
+        for (long i = 0; i < calls; i++) fn();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - begin).count();
+    }
+
+    /**
+     * @param sorted Ascending samples
+     * @param q Quantile in [0, 1]
+     * @return Linearly interpolated quantile of the samples
+     */
+    static double quantile(const std::vector<double>& sorted, double q) {
+        double pos = q * (sorted.size() - 1);
+        size_t i = static_cast<size_t>(pos);
+        if (i + 1 >= sorted.size()) return sorted.back();
+        return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+    }
+
+    void record(const std::string& group, const std::string& name, const std::string& unit, int warmup,
+                long operations, std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        bench_result r;
+        r.group = group;
+        r.name = name;
+        r.unit = unit;
+        r.warmup = warmup;
+        r.repetitions = static_cast<int>(samples.size());
+        r.operations = operations;
+        r.min = samples.front();
+        r.max = samples.back();
+        r.p10 = quantile(samples, 0.1);
+        r.median = quantile(samples, 0.5);
+        r.p90 = quantile(samples, 0.9);
+        r.p99 = quantile(samples, 0.99);
+        double sum = 0, sum_sq = 0;
+        for (double s : samples) sum += s;
+        r.mean = sum / samples.size();
+        for (double s : samples) sum_sq += (s - r.mean) * (s - r.mean);
+        r.stddev = std::sqrt(sum_sq / samples.size());
+        all.push_back(r);
+    }
+
+private:
+    settings config;
+    std::vector<bench_result> all;
+};
+
+#endif //CPU_RAYMARCHER_BENCHMARK_H
@@ -0,0 +1,80 @@
+#ifndef CPU_RAYMARCHER_DEMO_SCENE_H
+#define CPU_RAYMARCHER_DEMO_SCENE_H
+
+#include "shader/raymarch/scene_builder.h"
+#include "shader/raymarch/static_objects.h"
+
+/**
+ * Adds the light sources of the demo scene and sets its ambient light
+ */
+inline void init_lights(scene_builder& scn) {
+    scn.ambient_light = 0.15;
+
+    scn += scn.make<global_light_source>(vec3(-2, -2, -1.5), 1);
+//    scn += scn.make<point_light_source>(vec3(0, 3, 0), 100, 15);
+//    scn += scn.make<point_light_source>(vec3(0, 3, 0), 1, 0);
+}
+
+/**
+ * Adds the demo scene that the cpu_raymarcher executable renders, including its light sources. Shared with the
+ * benchmarks
+ */
+inline void init_scene(scene_builder& scn) {
+    init_lights(scn);
+
+    auto ball_with_hole = scn.make<sdf_padded>(
+            scn.make<sdf_diff>(
+                    vec3(0, 0, 0),
+                    scn.make<sdf_sphere>(point3(0, 0, 0), .3),
+                    scn.make<sdf_sphere>(point3(-0.13, 0.2, 0.1), .4)
+            ),
+            0.1);
+    ball_with_hole->set_diffuse_color(color(0.7, 0.3, 0.4));
+
+    auto pole = scn.make<sdf_capsule>(vec3(0, -1, 0), vec3(0, 1, 0), 0.05);
+    pole->set_diffuse_color(color(0.7));
+
+    auto complex = scn.make<sdf_union>(vec3(0, 0, -2), ball_with_hole, pole);
+    scn += complex;
+
+    auto small_ball = scn.make<sdf_sphere>(point3(-0.6, 0.6, -1.22), .15);
+    small_ball->set_diffuse_color(color(0.1, 0.3, 0.8));
+    scn += small_ball;
+
+    auto ground = scn.make<sdf_ground_plane>(-1.0);
+    ground->set_diffuse_color(color(0.15, 0.75, 0.3));
+    scn += ground;
+
+    auto cylinder = scn.make<sdf_cylinder>(vec3(-3.5, -0.7, -10), 0.6, 0.2);
+    cylinder->set_diffuse_color(color(0.7, 0.65, 0.3));
+    scn += cylinder;
+
+    auto capsule = scn.make<sdf_capsule>(vec3(2, 0, -4), unit_vector(0.5, 2, 1.5), 0.5, 0.2);
+    capsule->set_diffuse_color(color(0.8, 0.3, 0.95));
+    scn += capsule;
+}
+
+/**
+ * Same geometry as init_scene, composed at compile time
+ */
+inline auto make_static_scene() {
+    auto ball_with_hole = static_padded(
+            static_diff(
+                    vec3(0, 0, 0),
+                    static_sphere(point3(0, 0, 0), .3, color(0.7, 0.3, 0.4)),
+                    static_sphere(point3(-0.13, 0.2, 0.1), .4, color(0.7, 0.3, 0.4))
+            ),
+            0.1);
+    auto pole = static_capsule(vec3(0, -1, 0), vec3(0, 1, 0), 0.05, color(0.7));
+    auto complex = static_union(vec3(0, 0, -2), ball_with_hole, pole);
+
+    auto small_ball = static_sphere(point3(-0.6, 0.6, -1.22), .15, color(0.1, 0.3, 0.8));
+    auto ground = static_ground_plane(-1.0, color(0.15, 0.75, 0.3));
+    auto cylinder = static_cylinder(vec3(-3.5, -0.7, -10), 0.6, 0.2, color(0.7, 0.65, 0.3));
+    auto capsule = static_capsule(vec3(2, 0, -4), unit_vector(0.5, 2, 1.5), 0.5, 0.2, color(0.8, 0.3, 0.95));
+
+    return static_union(vec3(), static_union(vec3(), complex, small_ball),
+                        static_union(vec3(), ground, static_union(vec3(), cylinder, capsule)));
+}
+
+#endif //CPU_RAYMARCHER_DEMO_SCENE_H
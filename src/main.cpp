@@ -3,6 +3,9 @@
 #include <vector>
 #include <functional>
 #include <chrono>
+#include <memory>
+#include <fstream>
+#include <cstdio>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb/stb_image_write.hpp"
@@ -11,83 +14,81 @@
 #define IMG_HEIGHT(_var_w, _var_h, aspect_ratio, height) const int _var_h = (height); const int _var_w = static_cast<int>(_var_h * (aspect_ratio));
 
 #include "util/vec3.h"
+#include "util/trace.h"
+#include "util/perf_counters.h"
+#include "render/render_pool.h"
 #include "shader/ray_march_depth_shader.h"
-#include "render/renderer.h"
-
-constexpr int WORKER_COUNT = 96;
-
-void init_scene(scene& scn) {
-    scn.ambient_light = 0.15;
-
-    auto ball_with_hole = new sdf_padded(
-            new sdf_diff(
-                    vec3(0, 0, 0),
-                    new sdf_sphere(point3(0, 0, 0), .3),
-                    new sdf_sphere(point3(-0.13, 0.2, 0.1), .4)
-            ),
-            0.1);
-    ball_with_hole->set_diffuse_color(color(0.7, 0.3, 0.4));
-
-    auto pole = new sdf_capsule(vec3(0, -1, 0), vec3(0, 1, 0), 0.05);
-    pole->set_diffuse_color(color(0.7));
-
-    auto complex = new sdf_union(vec3(0, 0, -2), ball_with_hole, pole);
-    scn += complex;
-
-    auto small_ball = new sdf_sphere(point3(-0.6, 0.6, -1.22), .15);
-    small_ball->set_diffuse_color(color(0.1, 0.3, 0.8));
-    scn += small_ball;
-
-    auto ground = new sdf_ground_plane(-1.0);
-    ground->set_diffuse_color(color(0.15, 0.75, 0.3));
-    scn += ground;
-
-    auto cylinder = new sdf_cylinder(vec3(-3.5, -0.7, -10), 0.6, 0.2);
-    cylinder->set_diffuse_color(color(0.7, 0.65, 0.3));
-    scn += cylinder;
-
-    auto capsule = new sdf_capsule(vec3(2, 0, -4), unit_vector(0.5, 2, 1.5), 0.5, 0.2);
-    capsule->set_diffuse_color(color(0.8, 0.3, 0.95));
-    scn += capsule;
-
-    scn += new global_light_source(vec3(-2, -2, -1.5), 1);
-//    scn += new point_light_source(vec3(0, 3, 0), 100, 15);
-//    scn += new point_light_source(vec3(0, 3, 0), 1, 0);
+#include "shader/static_ray_march_shader.h"
+#include "shader/cost_heatmap_shader.h"
+#include "demo_scene.h"
+
+constexpr int TILE_SIZE = 32;
+constexpr bool STATIC_SCENE = false;
+
+// Measures the cost of every pixel, prints its distribution and writes a heatmap of the march steps
+constexpr bool COST_HEATMAP = false;
+
+// Reports the evaluations and time per node of the object trees. Needs the CPU_RAYMARCHER_SDF_PROFILER build option
+constexpr bool SDF_PROFILE = false;
+
+// Records a timeline of the phases of main and the tiles of every render worker into out/trace.json, which can be
+// opened in chrome://tracing or ui.perfetto.dev
+constexpr bool TRACE = false;
+
+// Counts cycles, instructions, cache and branch misses per thread and phase with perf_event_open (Linux only)
+constexpr bool PERF_COUNTERS = false;
+
+/**
+ * Writes a block of memory into a file
+ * @return Whether the whole block was written
+ */
+static bool write_file(const char* path, const unsigned char* data, int length) {
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr) return false;
+    bool written = std::fwrite(data, 1, length, file) == static_cast<size_t>(length);
+    return std::fclose(file) == 0 && written;
 }
 
 int main() {
+    tracer::set_enabled(TRACE);
+    tracer::set_thread_name("main");
+    perf_monitor::set_enabled(PERF_COUNTERS);
+    perf_monitor::set_thread_name("main");
+
     // Image data
     IMG_HEIGHT(image_width, image_height, 16.0 / 9.0, 600)
     const int channels = 3;
     unsigned char img_data[image_width * image_height * channels];
 
-    // Render thread function
-    auto scn = scene();
-    init_scene(scn);
-    auto shader = new ray_march_depth_shader(scn);
-
-    auto render_job = [](frag_shader* shader, unsigned char* img_data, int start_index, int end_index) {
-        return [shader, img_data, start_index, end_index]() {
-            renderer render(shader);
-            render.render_segment(img_data, image_width, image_height, start_index, end_index);
-        };
-    };
-
-    // Create and start all worker threads
-    std::vector<std::thread> workers;
-    auto begin_time = std::chrono::steady_clock::now();
-    int pixels_per_worker = static_cast<int>(image_width * image_height / WORKER_COUNT);
-    for (int i = 0; i < WORKER_COUNT; i++) {
-        int start = i * pixels_per_worker;
-        int end = (i == WORKER_COUNT - 1) ? (image_height * image_width) : (start + pixels_per_worker);
-        workers.push_back(std::thread(render_job(shader, img_data, start, end)));
+    // Worker threads are started once and reused for every submitted frame
+    render_pool pool(0, TILE_SIZE);
+
+    frag_shader* shader;
+    {
+        TRACE_SCOPE("scene setup", "main");
+        PERF_SCOPE("scene setup");
+        scene_builder builder;
+        if (STATIC_SCENE) {
+            init_lights(builder);
+            shader = new static_ray_march_shader<decltype(make_static_scene()), ray_march_depth_shader>(
+                    builder.freeze(), make_static_scene());
+        } else {
+            init_scene(builder);
+            shader = new ray_march_depth_shader(builder.freeze());
+        }
     }
 
-    // Wait for all threads to finish
-    for (int i = 0; i < WORKER_COUNT; i++) {
-        workers[i].join();
+    if (SDF_PROFILE) {
+        if (sdf_profiler::available()) sdf_profiler::set_enabled(true);
+        else std::cout << "SDF profiler not compiled in, configure with -DCPU_RAYMARCHER_SDF_PROFILER=ON" << std::endl;
     }
 
+    cost_map costs;
+    auto begin_time = std::chrono::steady_clock::now();
+    {
+        TRACE_SCOPE("render", "main", "width", image_width, "height", image_height);
+        pool.submit(shader, img_data, image_width, image_height, COST_HEATMAP ? &costs : nullptr).wait();
+    }
     auto end_time = std::chrono::steady_clock::now();
 
     std::cout << "Render time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - begin_time).count()
@@ -95,9 +96,54 @@ int main() {
 
     // Write to png file
     begin_time = std::chrono::steady_clock::now();
-    stbi_write_png("../out/image.png", image_width, image_height, channels, img_data, image_width * channels);
+    int png_length = 0;
+    unsigned char* png;
+    {
+        TRACE_SCOPE("encode", "main");
+        PERF_SCOPE("encode");
+        png = stbi_write_png_to_mem(img_data, image_width * channels, image_width, image_height, channels, &png_length);
+    }
+    {
+        TRACE_SCOPE("write", "main", "bytes", png_length);
+        PERF_SCOPE("write");
+        if (png == nullptr || !write_file("../out/image.png", png, png_length)) {
+            std::cout << "Could not write ../out/image.png" << std::endl;
+        }
+    }
+    STBIW_FREE(png);
     end_time = std::chrono::steady_clock::now();
 
     std::cout << "File write time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - begin_time).count()
               << "ms " << std::endl;
+
+    if (SDF_PROFILE && sdf_profiler::active()) {
+        sdf_profiler::set_enabled(false);
+        sdf_profiler::print_report(std::cout);
+    }
+
+    if (COST_HEATMAP) {
+        for (auto metric : {cost_metric::steps, cost_metric::sdf_evals, cost_metric::time}) {
+            costs.print_summary(std::cout, metric);
+        }
+
+        cost_heatmap_shader heatmap(costs, cost_metric::steps);
+        pool.submit(&heatmap, img_data, image_width, image_height).wait();
+        stbi_write_png("../out/cost_heatmap.png", image_width, image_height, channels, img_data,
+                       image_width * channels);
+        std::cout << "Heatmap of march steps written, red is " << heatmap.get_scale() << " steps" << std::endl;
+    }
+
+    if (PERF_COUNTERS) {
+        perf_monitor::set_enabled(false);
+        perf_monitor::report(std::cout, static_cast<long>(image_width) * image_height);
+    }
+
+    if (TRACE) {
+        tracer::set_enabled(false);
+        std::ofstream trace_file("../out/trace.json");
+        tracer::write_json(trace_file);
+        std::cout << "Trace written to ../out/trace.json" << std::endl;
+    }
+
+    delete shader;
 }
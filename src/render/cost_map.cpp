@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "cost_map.h"
+
+double cost_map::quantile(cost_metric metric, double q) const {
+    if (costs.empty()) return 0;
+    std::vector<double> values = sorted(metric);
+    return values[static_cast<size_t>(q * (values.size() - 1) + 0.5)];
+}
+
+void cost_map::print_summary(std::ostream& out, cost_metric metric, int bins) const {
+    if (costs.empty()) return;
+    std::vector<double> values = sorted(metric);
+    auto q = [&](double f) { return values[static_cast<size_t>(f * (values.size() - 1) + 0.5)]; };
+    double sum = 0;
+    for (double v : values) sum += v;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%s per pixel: mean %.1f, median %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+                  cost_metric_name(metric), sum / values.size(), q(0.5), q(0.9), q(0.99), values.back());
+    out << line;
+
+    // Costs have long tails, so the bins only cover the range up to the 99th percentile and everything above it
+    // goes into an additional last bin
+    bins = std::max(bins, 1);
+    double range = q(0.99) > 0 ? q(0.99) : values.back();
+    const double bin_width = range > 0 ? range / bins : 1;
+    std::vector<long> counts(bins + 1, 0);
+    std::vector<double> sums(bins + 1, 0.0);
+    for (double v : values) {
+        int bin = v > range ? bins : std::min(static_cast<int>(v / bin_width), bins - 1);
+        counts[bin]++;
+        sums[bin] += v;
+    }
+    for (int i = 0; i <= bins; i++) {
+        if (i == bins && counts[i] == 0) break;
+        double pixels = 100.0 * counts[i] / values.size();
+        double cost = sum > 0 ? 100.0 * sums[i] / sum : 0;
+        double upper = i < bins ? (i + 1) * bin_width : values.back();
+        std::snprintf(line, sizeof(line), "  [%10.1f, %10.1f%c %6.2f%% pixels %6.2f%% cost |", i * bin_width, upper,
+                      i < bins ? ')' : ']', pixels, cost);
+        out << line << std::string(static_cast<size_t>(pixels / 2 + 0.5), '#') << "\n";
+    }
+}
+
+std::vector<double> cost_map::sorted(cost_metric metric) const {
+    std::vector<double> values;
+    values.reserve(costs.size());
+    for (const auto& c : costs) values.push_back(value(c, metric));
+    std::sort(values.begin(), values.end());
+    return values;
+}
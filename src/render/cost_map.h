@@ -0,0 +1,147 @@
+#ifndef CPU_RAYMARCHER_COST_MAP_H
+#define CPU_RAYMARCHER_COST_MAP_H
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+#include "../util/cost_counters.h"
+
+/**
+ * Work spent on shading a single pixel
+ */
+struct pixel_cost {
+    float steps = 0;
+    float sdf_evals = 0;
+    float nanoseconds = 0;
+};
+
+/**
+ * The quantities a cost_map records per pixel
+ */
+enum class cost_metric {
+    steps,
+    sdf_evals,
+    time
+};
+
+/**
+ * @return Human-readable name of a metric, including its unit
+ */
+inline const char* cost_metric_name(cost_metric metric) {
+    switch (metric) {
+        case cost_metric::steps: return "march steps";
+        case cost_metric::sdf_evals: return "sdf evaluations";
+        default: return "time (ns)";
+    }
+}
+
+/**
+ * Per-pixel cost of a rendered frame: march steps, distance evaluations and wall time, see cost_counters. Filled in
+ * by the render workers when it is passed to render_pool::submit. Pixels that are shaded together as a packet share
+ * its cost evenly, and the per-frame work of frag_shader::begin_frame isn't attributed to any pixel
+ */
+class cost_map {
+public:
+    /**
+     * Resizes the map to a resolution and resets all costs to 0
+     */
+    void reset(int _width, int _height) {
+        width = _width;
+        height = _height;
+        costs.assign(static_cast<size_t>(width) * height, pixel_cost());
+    }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+
+    /**
+     * @param pixel_index Index of the pixel in row-major order
+     */
+    pixel_cost& at(int pixel_index) { return costs[pixel_index]; }
+    const pixel_cost& at(int pixel_index) const { return costs[pixel_index]; }
+
+    /**
+     * @return Value of a metric of a pixel
+     */
+    static double value(const pixel_cost& c, cost_metric metric) {
+        switch (metric) {
+            case cost_metric::steps: return c.steps;
+            case cost_metric::sdf_evals: return c.sdf_evals;
+            default: return c.nanoseconds;
+        }
+    }
+
+    /**
+     * @return Sum of a metric over all pixels
+     */
+    double total(cost_metric metric) const {
+        double sum = 0;
+        for (const auto& c : costs) sum += value(c, metric);
+        return sum;
+    }
+
+    /**
+     * @param q Quantile in [0, 1]
+     * @return Quantile of a metric over all pixels
+     */
+    double quantile(cost_metric metric, double q) const;
+
+    /**
+     * Writes the distribution of a metric over the pixels: a few quantiles, followed by a histogram with the share
+     * of the pixels and of the total cost that falls into each bin
+     * @param out Output stream
+     * @param metric Metric to be summarized
+     * @param bins Number of histogram bins, spread evenly up to the 99th percentile. The pixels above it are counted
+     * in one more bin
+     */
+    void print_summary(std::ostream& out, cost_metric metric, int bins = 16) const;
+
+private:
+    /**
+     * @return Values of a metric of all pixels in ascending order
+     */
+    std::vector<double> sorted(cost_metric metric) const;
+
+private:
+    int width = 0;
+    int height = 0;
+    std::vector<pixel_cost> costs;
+};
+
+/**
+ * Measures the cost of shading a group of pixels on the calling thread: takes the thread's cost_counters and the
+ * time at construction and records the differences into a cost_map
+ */
+class cost_probe {
+public:
+    cost_probe() : counters(cost_counters::local()), begin_counters(counters),
+        begin_time(std::chrono::steady_clock::now()) {}
+
+    /**
+     * Records the cost since construction, split evenly over a run of pixels
+     * @param costs Map to record the cost into
+     * @param first_pixel Index of the first pixel of the run
+     * @param count Number of pixels of the run
+     */
+    void record(cost_map& costs, int first_pixel, int count) const {
+        auto end_time = std::chrono::steady_clock::now();
+        float share = 1.0f / count;
+        float steps = static_cast<float>(counters.steps - begin_counters.steps) * share;
+        float sdf_evals = static_cast<float>(counters.sdf_evals - begin_counters.sdf_evals) * share;
+        float nanoseconds = std::chrono::duration<float, std::nano>(end_time - begin_time).count() * share;
+        for (int i = first_pixel; i < first_pixel + count; i++) {
+            pixel_cost& c = costs.at(i);
+            c.steps += steps;
+            c.sdf_evals += sdf_evals;
+            c.nanoseconds += nanoseconds;
+        }
+    }
+
+private:
+    const cost_counters& counters;
+    cost_counters begin_counters;
+    std::chrono::steady_clock::time_point begin_time;
+};
+
+#endif //CPU_RAYMARCHER_COST_MAP_H
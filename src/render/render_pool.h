@@ -0,0 +1,187 @@
+#ifndef CPU_RAYMARCHER_RENDER_POOL_H
+#define CPU_RAYMARCHER_RENDER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../shader/frag_shader.h"
+#include "../util/perf_counters.h"
+#include "renderer.h"
+#include "tile_scheduler.h"
+
+/**
+ * Completion handle of a frame that was submitted to a render_pool
+ */
+class render_handle {
+public:
+    render_handle() = default;
+    explicit render_handle(std::shared_future<void> _done) : done(std::move(_done)) {}
+
+    /**
+     * Blocks until all pixels of the frame have been written to the target buffer
+     */
+    void wait() const { done.wait(); }
+
+    /**
+     * @return Whether all pixels of the frame have been written to the target buffer
+     */
+    bool ready() const {
+        return done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+private:
+    std::shared_future<void> done;
+};
+
+/**
+ * Long-lived pool of render workers. Frames are submitted as a fragment shader plus a target buffer and are rendered
+ * tile by tile through a work-stealing tile_scheduler. Frames are processed in submission order, the workers are
+ * started once and reused for every frame
+ */
+class render_pool {
+public:
+    /**
+     * Starts the worker threads of the pool
+     * @param _worker_count Number of worker threads. Values below 1 select std::thread::hardware_concurrency()
+     * @param _tile_size Edge length of the tiles frames are split into. Values below 1 select 1
+     */
+    explicit render_pool(int _worker_count = 0, int _tile_size = 32) : tile_size(_tile_size < 1 ? 1 : _tile_size) {
+        if (_worker_count < 1) _worker_count = static_cast<int>(std::thread::hardware_concurrency());
+        if (_worker_count < 1) _worker_count = 1;
+
+        for (int i = 0; i < _worker_count; i++) {
+            workers.emplace_back([this, i]() { work(i); });
+        }
+    }
+
+    render_pool(const render_pool&) = delete;
+    render_pool& operator=(const render_pool&) = delete;
+
+    /**
+     * Finishes all submitted frames and stops the worker threads
+     */
+    ~render_pool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    /**
+     * Queues a frame for rendering. The shader and the target buffer must stay alive until the frame is completed.
+     * frag_shader::begin_frame is called on the calling thread and replaces the per-frame data of the shader, e.g. the
+     * prepass of a ray_march_shader, so only one frame per shader may be in flight: wait for the handle of its
+     * previous frame before submitting a shader again. Different shaders can be in flight at the same time
+     * @param shader Fragment shader used for every pixel of the frame
+     * @param target_data Pointer to the beginning of a 24-bit RGB buffer of target_width * target_height pixels
+     * @param target_width Width of the image in pixels. Negative values are treated as 0
+     * @param target_height Height of the image in pixels. Negative values are treated as 0
+     * @param costs Receives the cost of every pixel of the frame, nullptr to not measure it. It is reset to the
+     * resolution of the frame and must stay alive until the frame is completed, like the target buffer. The
+     * cost_counters of the ray marcher are only switched on while the workers render tiles of this frame
+     * @return Handle that completes once the whole frame has been rendered
+     */
+    render_handle submit(frag_shader* shader, unsigned char* target_data, int target_width, int target_height,
+                         cost_map* costs = nullptr) {
+        // Frames without pixels complete right away
+        if (target_width < 0) target_width = 0;
+        if (target_height < 0) target_height = 0;
+        if (costs != nullptr) costs->reset(target_width, target_height);
+        {
+            TRACE_SCOPE("begin_frame", "frame", "width", target_width, "height", target_height);
+            PERF_SCOPE("begin_frame");
+            shader->begin_frame(target_width, target_height);
+        }
+        auto job = std::make_shared<frame_job>(shader, target_data, target_width, target_height, tile_size,
+                                               worker_count(), costs);
+        render_handle handle(job->done.get_future().share());
+        if (job->remaining == 0) {
+            job->done.set_value();
+            return handle;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            frames.push_back(job);
+        }
+        wakeup.notify_all();
+        return handle;
+    }
+
+    int worker_count() const { return static_cast<int>(workers.size()); }
+
+private:
+    /**
+     * A submitted frame along with the tiles that have not been handed out yet
+     */
+    struct frame_job {
+        frame_job(frag_shader* _shader, unsigned char* _target_data, int _target_width, int _target_height,
+                  int tile_size, int worker_count, cost_map* _costs)
+            : shader(_shader), target_data(_target_data), target_width(_target_width), target_height(_target_height),
+              costs(_costs),
+              scheduler(_target_width, _target_height, tile_size, worker_count),
+              remaining(((_target_width + tile_size - 1) / tile_size) * ((_target_height + tile_size - 1) / tile_size)) {}
+
+        frag_shader* shader;
+        unsigned char* target_data;
+        int target_width;
+        int target_height;
+        cost_map* costs;
+        tile_scheduler scheduler;
+        std::atomic<int> remaining;
+        std::promise<void> done;
+    };
+
+    /**
+     * Worker thread function: renders tiles of the oldest unfinished frame until the pool is stopped
+     * @param worker Index of the worker
+     */
+    void work(int worker) {
+        tracer::set_thread_name("render worker " + std::to_string(worker));
+        perf_monitor::set_thread_name("render worker " + std::to_string(worker));
+        while (true) {
+            std::shared_ptr<frame_job> job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wakeup.wait(guard, [this]() { return stopping || !frames.empty(); });
+                if (frames.empty()) return;
+                job = frames.front();
+            }
+
+            tile t {};
+            if (job->scheduler.next(worker, t)) {
+                {
+                    PERF_SCOPE("render");
+                    // Frames without a cost_map don't pay for counting, even while a measured frame is in flight
+                    cost_counters::set_enabled(job->costs != nullptr);
+                    renderer render(job->shader, job->costs);
+                    render.render_tile(job->target_data, job->target_width, job->target_height, t);
+                }
+                if (--job->remaining == 0) job->done.set_value();
+            } else {
+                // All tiles of the frame are handed out, the workers still busy with it finish it on their own
+                std::lock_guard<std::mutex> guard(lock);
+                if (!frames.empty() && frames.front() == job) frames.pop_front();
+            }
+        }
+    }
+
+private:
+    int tile_size;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::deque<std::shared_ptr<frame_job>> frames;
+    bool stopping = false;
+};
+
+#endif //CPU_RAYMARCHER_RENDER_POOL_H
@@ -3,6 +3,9 @@
 
 #include "../util/vec3.h"
 #include "../shader/frag_shader.h"
+#include "tile_scheduler.h"
+#include "cost_map.h"
+#include "../util/trace.h"
 
 /**
  * Renderer that renders pixel fragments into a heap allocated array segment of RGB data. It uses the
@@ -11,7 +14,11 @@
  */
 class renderer {
 public:
-    explicit renderer(frag_shader* _shader) : shader(_shader) { }
+    /**
+     * @param _shader Shader of every pixel
+     * @param _costs Receives the cost of every rendered pixel, nullptr to not measure it
+     */
+    explicit renderer(frag_shader* _shader, cost_map* _costs = nullptr) : shader(_shader), costs(_costs) { }
 
     /**
      * Renders pixel data into a 24-bit RGB buffer
@@ -22,16 +29,79 @@ public:
      * @param end_pixel Pixel index of the first pixel AFTER the segment to be rendered
      */
     void render_segment(unsigned char* target_data, int target_width, int target_height, int begin_pixel, int end_pixel) {
+        TRACE_SCOPE("segment", "render", "begin", begin_pixel, "end", end_pixel);
         int pixel_index = begin_pixel;
         while(pixel_index < end_pixel) {
-            double ux = double(pixel_index % target_width) / target_width; // NOLINT(bugprone-integer-division)
-            double uy = 1.0-double(pixel_index / target_width) / target_height; // NOLINT(bugprone-integer-division)
-            write_color(target_data, pixel_index * 3, shader->frag(vec3(ux, uy, 0)));
+            render_pixel(target_data, target_width, target_height, pixel_index);
             pixel_index++;
         }
     }
 
+    /**
+     * Renders the pixels of a rectangular tile into a 24-bit RGB buffer
+     * @param target_data Pointer to beginning of the buffer
+     * @param target_width Width of the complete image to be rendered
+     * @param target_height Height of the complete image to be rendered
+     * @param t Tile to be rendered
+     */
+    void render_tile(unsigned char* target_data, int target_width, int target_height, const tile& t) {
+        TRACE_SCOPE("tile", "render", "x", t.x0, "y", t.y0);
+        for (int y = t.y0; y < t.y1; y++) {
+            int x = t.x0;
+            for (; x + FRAG_PACKET_SIZE <= t.x1; x += FRAG_PACKET_SIZE) {
+                render_packet(target_data, target_width, target_height, y * target_width + x);
+            }
+            for (; x < t.x1; x++) {
+                render_pixel(target_data, target_width, target_height, y * target_width + x);
+            }
+        }
+    }
+
 private:
+    /**
+     * Renders a single pixel into a 24-bit RGB buffer
+     * @param target_data Pointer to beginning of the buffer
+     * @param target_width Width of the complete image to be rendered
+     * @param target_height Height of the complete image to be rendered
+     * @param pixel_index Index of the pixel to be rendered
+     */
+    void render_pixel(unsigned char* target_data, int target_width, int target_height, int pixel_index) {
+        double ux = double(pixel_index % target_width) / target_width; // NOLINT(bugprone-integer-division)
+        double uy = 1.0-double(pixel_index / target_width) / target_height; // NOLINT(bugprone-integer-division)
+        if (costs == nullptr) {
+            write_color(target_data, pixel_index * 3, shader->frag(vec3(ux, uy, 0)));
+            return;
+        }
+        cost_probe probe;
+        color col = shader->frag(vec3(ux, uy, 0));
+        probe.record(*costs, pixel_index, 1);
+        write_color(target_data, pixel_index * 3, col);
+    }
+
+    /**
+     * Renders FRAG_PACKET_SIZE horizontally adjacent pixels of the same row into a 24-bit RGB buffer
+     * @param target_data Pointer to beginning of the buffer
+     * @param target_width Width of the complete image to be rendered
+     * @param target_height Height of the complete image to be rendered
+     * @param pixel_index Index of the leftmost pixel of the packet
+     */
+    void render_packet(unsigned char* target_data, int target_width, int target_height, int pixel_index) {
+        vec3 uv[FRAG_PACKET_SIZE];
+        color cols[FRAG_PACKET_SIZE];
+        double uy = 1.0-double(pixel_index / target_width) / target_height; // NOLINT(bugprone-integer-division)
+        for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+            uv[i] = vec3(double((pixel_index + i) % target_width) / target_width, uy, 0);
+        }
+        if (costs == nullptr) {
+            shader->frag_packet(uv, cols);
+        } else {
+            cost_probe probe;
+            shader->frag_packet(uv, cols);
+            probe.record(*costs, pixel_index, FRAG_PACKET_SIZE);
+        }
+        for (int i = 0; i < FRAG_PACKET_SIZE; i++) write_color(target_data, (pixel_index + i) * 3, cols[i]);
+    }
+
     /**
      * Shorthand function to write a single 24-bit RGB pixel into a buffer
      * @param img_data Pointer to beginning of the buffer
@@ -50,6 +120,7 @@ private:
 
 private:
     frag_shader* shader;
+    cost_map* costs;
 
 };
 
@@ -0,0 +1,94 @@
+#ifndef CPU_RAYMARCHER_TILE_SCHEDULER_H
+#define CPU_RAYMARCHER_TILE_SCHEDULER_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Rectangular block of pixels of the target image. Covers the pixels [x0, x1) x [y0, y1)
+ */
+struct tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+/**
+ * Hands out fixed-size tiles of an image to a number of render workers. Each worker owns a deque of tiles that it
+ * works through front to back. A worker that runs out of tiles steals from the back of another worker's deque, so
+ * expensive regions of the image get spread over all workers instead of bounding the frame time of a single one.
+ */
+class tile_scheduler {
+public:
+    /**
+     * Splits an image into tiles and distributes them in contiguous runs over the workers' deques
+     * @param image_width Width of the image in pixels
+     * @param image_height Height of the image in pixels
+     * @param tile_size Edge length of a tile in pixels. Tiles at the right and bottom borders may be smaller
+     * @param worker_count Number of workers that will pull tiles from this scheduler
+     */
+    tile_scheduler(int image_width, int image_height, int tile_size, int worker_count) {
+        if (tile_size < 1) tile_size = 1;
+        if (worker_count < 1) worker_count = 1;
+
+        std::vector<tile> tiles;
+        for (int y = 0; y < image_height; y += tile_size) {
+            for (int x = 0; x < image_width; x += tile_size) {
+                int x1 = (x + tile_size < image_width) ? x + tile_size : image_width;
+                int y1 = (y + tile_size < image_height) ? y + tile_size : image_height;
+                tiles.push_back(tile{x, y, x1, y1});
+            }
+        }
+
+        for (int i = 0; i < worker_count; i++) queues.emplace_back(new tile_queue());
+        for (size_t i = 0; i < tiles.size(); i++) {
+            queues[i * worker_count / tiles.size()]->tiles.push_back(tiles[i]);
+        }
+    }
+
+    /**
+     * Fetches the next tile for a worker. Takes from the front of the worker's own deque and falls back to stealing
+     * from the back of the other workers' deques once that is empty
+     * @param worker Index of the calling worker in [0, worker_count)
+     * @param out Receives the tile to be rendered
+     * @return Whether a tile was fetched. 'false' means that all tiles of the image have been handed out
+     */
+    bool next(int worker, tile& out) {
+        if (pop_front(*queues[worker], out)) return true;
+
+        for (size_t i = 1; i < queues.size(); i++) {
+            if (pop_back(*queues[(worker + i) % queues.size()], out)) return true;
+        }
+        return false;
+    }
+
+    int worker_count() const { return static_cast<int>(queues.size()); }
+
+private:
+    struct tile_queue {
+        std::mutex lock;
+        std::deque<tile> tiles;
+    };
+
+    static bool pop_front(tile_queue& queue, tile& out) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tiles.empty()) return false;
+        out = queue.tiles.front();
+        queue.tiles.pop_front();
+        return true;
+    }
+
+    static bool pop_back(tile_queue& queue, tile& out) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tiles.empty()) return false;
+        out = queue.tiles.back();
+        queue.tiles.pop_back();
+        return true;
+    }
+
+private:
+    std::vector<std::unique_ptr<tile_queue>> queues;
+};
+
+#endif //CPU_RAYMARCHER_TILE_SCHEDULER_H
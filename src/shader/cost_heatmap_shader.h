@@ -0,0 +1,68 @@
+#ifndef CPU_RAYMARCHER_COST_HEATMAP_SHADER_H
+#define CPU_RAYMARCHER_COST_HEATMAP_SHADER_H
+
+#include "frag_shader.h"
+#include "../render/cost_map.h"
+
+/**
+ * Fragment shader that shows the per-pixel cost of a previously rendered frame as a false-colour image, from dark
+ * blue for cheap pixels over green and yellow to red for the most expensive ones. Pixels above the top of the scale
+ * are white
+ */
+class cost_heatmap_shader : public frag_shader {
+public:
+    /**
+     * @param _costs Costs of the rendered frame. Must stay alive and unchanged while this shader is used
+     * @param _metric Metric to be shown
+     * @param _scale Cost shown in red, 0 to use the 99th percentile of the frame
+     */
+    cost_heatmap_shader(const cost_map& _costs, cost_metric _metric, double _scale = 0)
+        : costs(_costs), metric(_metric), fixed_scale(_scale) {}
+
+    color frag(const vec3& uv) override {
+        if (costs.get_width() <= 0 || costs.get_height() <= 0) return color();
+
+        // Inverse of the pixel to UV mapping of the renderer, so maps of another resolution are sampled nearest
+        int x = static_cast<int>(uv.x() * costs.get_width() + 0.5);
+        int y = static_cast<int>((1.0 - uv.y()) * costs.get_height() + 0.5);
+        x = x < 0 ? 0 : (x >= costs.get_width() ? costs.get_width() - 1 : x);
+        y = y < 0 ? 0 : (y >= costs.get_height() ? costs.get_height() - 1 : y);
+
+        double v = cost_map::value(costs.at(y * costs.get_width() + x), metric) / scale;
+        return v > 1 ? color(1, 1, 1) : heat(v);
+    }
+
+    void begin_frame(int /*width*/, int /*height*/) override {
+        scale = fixed_scale > 0 ? fixed_scale : costs.quantile(metric, 0.99);
+        if (!(scale > 0)) scale = 1;
+    }
+
+    /**
+     * @return Cost shown in red in the last frame
+     */
+    double get_scale() const { return scale; }
+
+private:
+    /**
+     * @param v Relative cost in [0, 1]
+     * @return Colour of the relative cost, interpolated between a few stops
+     */
+    static color heat(double v) {
+        static const color stops[] = {color(0.02, 0.02, 0.2), color(0.1, 0.3, 0.9), color(0.1, 0.75, 0.45),
+                                      color(0.95, 0.85, 0.1), color(0.85, 0.1, 0.05)};
+        constexpr int last = sizeof(stops) / sizeof(stops[0]) - 1;
+        double pos = v * last;
+        int i = static_cast<int>(pos);
+        if (i >= last) return stops[last];
+        double f = pos - i;
+        return (1 - f) * stops[i] + f * stops[i + 1];
+    }
+
+private:
+    const cost_map& costs;
+    cost_metric metric;
+    double fixed_scale;
+    double scale = 1;
+};
+
+#endif //CPU_RAYMARCHER_COST_HEATMAP_SHADER_H
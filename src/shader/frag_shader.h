@@ -3,6 +3,11 @@
 
 #include "../util/vec3.h"
 
+/**
+ * Number of pixels passed to frag_shader::frag_packet
+ */
+constexpr int FRAG_PACKET_SIZE = 4;
+
 /**
  * Abstract fragment shader class
  */
@@ -15,6 +20,24 @@ public:
      */
     virtual color frag(const vec3& uv) = 0;
 
+    /**
+     * Returns the pixel colors for a packet of neighbouring UV coordinates. Shaders that can share work between
+     * neighbouring pixels override this; the default implementation shades each pixel on its own
+     * @param uv UV coordinates of FRAG_PACKET_SIZE pixels
+     * @param out_cols Receives the pixel colors
+     */
+    virtual void frag_packet(const vec3 uv[], color out_cols[]) {
+        for (int i = 0; i < FRAG_PACKET_SIZE; i++) out_cols[i] = frag(uv[i]);
+    }
+
+    /**
+     * Called once before any fragment of a frame is shaded. Informs the shader about the resolution of the image
+     * and lets it precompute per-frame data
+     * @param width Width of the image in pixels
+     * @param height Height of the image in pixels
+     */
+    virtual void begin_frame(int /*width*/, int /*height*/) {}
+
     virtual ~frag_shader() {};
 
 protected:
@@ -5,5 +5,7 @@
 #include "ray_march_depth_shader.h"
 
 void ray_march_depth_shader::frag_ray(raycast_info r_info, color& out_col) {
-    out_col = color(1.0 - smoothstep(r_info.travel / MAX_DIST)) * 0.85;
+    // Rays that ran out of steps are drawn as misses, not at the depth they gave up at
+    double depth = r_info.budget_exhausted ? MAX_DIST : r_info.travel;
+    out_col = color(1.0 - smoothstep(depth / MAX_DIST)) * 0.85;
 }
\ No newline at end of file
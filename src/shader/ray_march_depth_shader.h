@@ -5,7 +5,7 @@
 
 class ray_march_depth_shader : public ray_march_shader {
 public:
-    explicit ray_march_depth_shader(const scene& _scn) : ray_march_shader(_scn) {}
+    explicit ray_march_depth_shader(std::shared_ptr<const scene> _scn) : ray_march_shader(std::move(_scn)) {}
 
 protected:
     void frag_ray(raycast_info r_info, color &out_col) override;
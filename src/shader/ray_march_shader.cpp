@@ -1,36 +1,686 @@
+#include "../util/parallel.h"
 #include "ray_march_shader.h"
+#include "../util/cost_counters.h"
 
-raycast_info ray_march_shader::raycast(const ray& r, double distance_threshold, sdf_object* ignore, double min_travel) const {
+raycast_info ray_march_shader::raycast(const ray& r, double distance_threshold, sdf_object* ignore, double min_travel,
+                                       double cone_angle) const {
     raycast_info info {r.at(MAX_DIST), nullptr, MAX_DIST};
+    const bool hierarchy = use_bvh();
+    const bool compiled = !hierarchy && config.compiled_scene && program.valid() && !sdf_profiler::active();
+    const bool cached = config.distance_cache && !cache.empty() && ignore == nullptr;
+    thread_local std::vector<double> dists;
+    if (compiled) dists.resize(program.slot_count());
+    cost_counters* counters = cost_counters::counting();
+
+    // Two-phase marching falls back to the fixed threshold once a coarse hit turns out to be a near miss
+    double coarse_threshold = config.coarse_threshold;
+
+    // Over-relaxation state: relaxation factor, unbounding radius of the previous point and the last step taken
+    double omega = config.relaxation;
+    double prev_radius = 0;
+    double step = 0;
+
     double t = min_travel;
     while (t < MAX_DIST) {
         info.travel = t;
+        if (config.max_steps > 0 && info.steps >= config.max_steps) {
+            info.budget_exhausted = true;
+            return info;
+        }
+        info.steps++;
+        if (counters) counters->steps++;
+        const double threshold = max(max(distance_threshold, coarse_threshold), cone_angle * t);
         double local_min_dist = MAX_DIST;
+        double radius = MAX_DIST;
         vec3 p = r.at(t);
-        for(auto obj : scn.objects) {
-            if (obj == ignore) continue;
-            double d = obj->sdf(p);
+
+        if (cached) {
+            // Far from any surface the baked lower bound is a safe step on its own
+            double bound = cache.lower_bound(p);
+            if (bound > cache.band()) {
+                t += bound;
+                prev_radius = 0;
+                step = 0;
+                continue;
+            }
+        }
+
+        // Samples of steps that get taken back must not end up as the closest point of the ray
+        const double prev_min_dist = info.min_dist;
+        const point3 prev_hitpoint = info.hitpoint;
+        double target_dist = MAX_DIST;
+
+        // Records the distance to an object, returns 'true' once the ray collides with something. Distances are
+        // divided by the object's Lipschitz bound, so they can be stepped safely
+        auto consider = [&](sdf_object* obj, double d) {
+            d /= obj->lipschitz();
+            if (d < radius) radius = d;
             if (d < info.min_dist) {
                 info.min_dist = d;
                 info.hitpoint = p;
             }
-            if (d < distance_threshold) {
+            if (d < local_min_dist) local_min_dist = d;
+            if (d < threshold && d < target_dist) {
                 info.target = obj;
-                return info;
+                target_dist = d;
+                // A coarse hit gets refined towards its target, which has to be the closest object below the
+                // threshold or the refined point may end up inside a nearer one. The search goes on for that
+                return coarse_threshold <= 0;
             }
-            if (d < local_min_dist) local_min_dist = d;
+            return false;
+        };
+
+        if (hierarchy) {
+            accel.traverse([&](const aabb& box) { return box.distance(p) - local_min_dist; },
+                           [&](sdf_object* obj) {
+                               if (obj == ignore) return true;
+                               if (counters) counters->sdf_evals++;
+                               return !consider(obj, obj->sdf(p));
+                           });
+        } else {
+            if (compiled) {
+                program.eval(p, dists.data());
+                if (counters) counters->sdf_evals += static_cast<long>(scn->objects.size());
+            }
+            for (size_t i = 0; i < scn->objects.size(); i++) {
+                sdf_object* obj = scn->objects[i];
+                if (obj == ignore) continue;
+                if (counters && !compiled) counters->sdf_evals++;
+                if (consider(obj, compiled ? dists[i] : obj->sdf(p))) break;
+            }
+        }
+        const bool hit = info.target != nullptr;
+
+        if (omega > 1 && radius + prev_radius < step) {
+            // The unbounding spheres of the last two points don't overlap, so the relaxed step may have skipped a
+            // surface. Go back to the conservative step and continue without relaxation
+            info.target = nullptr;
+            info.min_dist = prev_min_dist;
+            info.hitpoint = prev_hitpoint;
+            t -= step - max(MIN_STEP, prev_radius);
+            step = max(MIN_STEP, prev_radius);
+            omega = 1;
+            info.relaxation_fallbacks++;
+            continue;
         }
-        t += max(MIN_STEP, local_min_dist);
+        if (hit) {
+            if (coarse_threshold > 0 && !refine_hit(r, info.target, info, distance_threshold, cone_angle)) {
+                info.target = nullptr;
+                coarse_threshold = 0;
+                t = info.travel;
+                prev_radius = 0;
+                step = 0;
+                continue;
+            }
+            info.target->sdf_leaf(info.hitpoint, info.surface);
+            return info;
+        }
+
+        prev_radius = local_min_dist;
+        step = max(MIN_STEP, omega * local_min_dist);
+        t += step;
     }
     info.travel = MAX_DIST;
     return info;
 }
 
+raycast_info ray_march_shader::segment_raycast(const ray& r, double distance_threshold, sdf_object* ignore,
+                                               double min_travel, double cone_angle) const {
+    raycast_info info {r.at(MAX_DIST), nullptr, MAX_DIST};
+    const bool cached = config.distance_cache && !cache.empty() && ignore == nullptr;
+
+    // Length of the segment of the ray the next step is searched on
+    double segment = MAX_DIST;
+    double coarse_threshold = config.coarse_threshold;
+    cost_counters* counters = cost_counters::counting();
+
+    double t = min_travel;
+    while (t < MAX_DIST) {
+        info.travel = t;
+        if (config.max_steps > 0 && info.steps >= config.max_steps) {
+            info.budget_exhausted = true;
+            return info;
+        }
+        info.steps++;
+        if (counters) counters->steps++;
+        const double threshold = max(max(distance_threshold, coarse_threshold), cone_angle * t);
+        vec3 p = r.at(t);
+
+        if (cached) {
+            double bound = cache.lower_bound(p);
+            if (bound > cache.band()) {
+                t += bound;
+                continue;
+            }
+        }
+
+        const double end = min(t + segment, MAX_DIST);
+        double step = end - t;
+        sdf_object* target = nullptr;
+        double target_dist = MAX_DIST;
+        for (auto obj : scn->objects) {
+            if (obj == ignore) continue;
+            if (counters) counters->sdf_evals++;
+            double d = obj->sdf(p);
+            double dist = d / obj->lipschitz();
+            if (dist < info.min_dist) {
+                info.min_dist = dist;
+                info.hitpoint = p;
+            }
+            if (dist < threshold && dist < target_dist) {
+                target = obj;
+                target_dist = dist;
+                // Coarse hits are refined towards the closest object below the threshold, see raycast
+                if (coarse_threshold <= 0) break;
+                continue;
+            }
+
+            // Objects that are further away than the segment is long can't shorten the step
+            if (dist < step) step = min(step, d / obj->segment_lipschitz(r, t, end));
+        }
+        if (target != nullptr) {
+            if (coarse_threshold > 0 && !refine_hit(r, target, info, distance_threshold, cone_angle)) {
+                // A near miss, see raycast
+                coarse_threshold = 0;
+                t = info.travel;
+                segment = MAX_DIST;
+                continue;
+            }
+            info.target = target;
+            target->sdf_leaf(info.hitpoint, info.surface);
+            return info;
+        }
+
+        step = max(MIN_STEP, step);
+        t += step;
+        segment = config.segment_growth * step;
+    }
+    info.travel = MAX_DIST;
+    return info;
+}
+
+void ray_march_shader::raycast_packet(const ray rays[], double distance_threshold, raycast_info out_infos[],
+                                      double min_travel, double cone_angle) const {
+    static_assert(FRAG_PACKET_SIZE == doublex4::WIDTH, "ray packets are marched in doublex4 lanes");
+
+    doublex4 ox(rays[0].origin().x(), rays[1].origin().x(), rays[2].origin().x(), rays[3].origin().x());
+    doublex4 oy(rays[0].origin().y(), rays[1].origin().y(), rays[2].origin().y(), rays[3].origin().y());
+    doublex4 oz(rays[0].origin().z(), rays[1].origin().z(), rays[2].origin().z(), rays[3].origin().z());
+    doublex4 dx(rays[0].direction().x(), rays[1].direction().x(), rays[2].direction().x(), rays[3].direction().x());
+    doublex4 dy(rays[0].direction().y(), rays[1].direction().y(), rays[2].direction().y(), rays[3].direction().y());
+    doublex4 dz(rays[0].direction().z(), rays[1].direction().z(), rays[2].direction().z(), rays[3].direction().z());
+
+    const doublex4 max_dist(MAX_DIST);
+    const doublex4 base_threshold(distance_threshold);
+    const doublex4 cone(cone_angle);
+    doublex4 t(min_travel);
+    doublex4 travel(MAX_DIST);
+    doublex4 min_dist(MAX_DIST);
+    doublex4 hx = ox + max_dist * dx, hy = oy + max_dist * dy, hz = oz + max_dist * dz;
+    sdf_object* targets[FRAG_PACKET_SIZE] = {nullptr, nullptr, nullptr, nullptr};
+
+    const bool hierarchy = use_bvh();
+    const bool compiled = !hierarchy && config.compiled_scene && program.valid() && !sdf_profiler::active();
+    const bool cached = config.distance_cache && !cache.empty();
+    thread_local std::vector<doublex4> dists;
+    if (compiled) dists.resize(program.slot_count());
+    cost_counters* counters = cost_counters::counting();
+
+    // Per-lane over-relaxation state, see raycast
+    doublex4 omega(config.relaxation);
+    doublex4 prev_radius(0.0);
+    doublex4 step(0.0);
+    int steps[FRAG_PACKET_SIZE] = {0, 0, 0, 0};
+    int fallbacks[FRAG_PACKET_SIZE] = {0, 0, 0, 0};
+    bool exhausted[FRAG_PACKET_SIZE] = {false, false, false, false};
+
+    // Per-lane coarse threshold of two-phase marching, and the refined hits, see raycast
+    doublex4 coarse(config.coarse_threshold);
+    raycast_info refined[FRAG_PACKET_SIZE];
+
+    maskx4 active = t < max_dist;
+    while (active.any()) {
+        travel = select(active, t, travel);
+        int out_of_budget = 0;
+        for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+            if (!active.lane(i)) continue;
+            if (config.max_steps > 0 && steps[i] >= config.max_steps) {
+                exhausted[i] = true;
+                out_of_budget |= 1 << i;
+                continue;
+            }
+            steps[i]++;
+            if (counters) counters->steps++;
+        }
+        if (out_of_budget) {
+            active = andnot(active, maskx4::from_bits(out_of_budget));
+            if (!active.any()) break;
+        }
+        const doublex4 threshold = vmax(vmax(base_threshold, coarse), cone * t);
+        doublex4 px = ox + t * dx, py = oy + t * dy, pz = oz + t * dz;
+        vec3x4 p(px, py, pz);
+
+        if (cached) {
+            // Skip the exact evaluation if every live lane is far enough from all surfaces
+            double bounds[FRAG_PACKET_SIZE];
+            bool far_field = true;
+            for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+                bounds[i] = active.lane(i) ? cache.lower_bound(p.lane(i)) : MAX_DIST;
+                far_field = far_field && bounds[i] > cache.band();
+            }
+            if (far_field) {
+                t = select(active, t + doublex4::load(bounds), t);
+                prev_radius = select(active, doublex4(0.0), prev_radius);
+                step = select(active, doublex4(0.0), step);
+                maskx4 out_of_range = active & (t >= max_dist);
+                travel = select(out_of_range, max_dist, travel);
+                active = andnot(active, out_of_range);
+                continue;
+            }
+        }
+
+        doublex4 local_min_dist(MAX_DIST);
+        doublex4 radius(MAX_DIST);
+        const maskx4 evaluated = active;
+        const doublex4 prev_min_dist = min_dist, prev_hx = hx, prev_hy = hy, prev_hz = hz;
+        maskx4 live = active;
+
+        // Lanes with a coarse hit keep looking for a closer object to refine towards, see raycast
+        maskx4 choosing(false);
+        doublex4 target_dist(MAX_DIST);
+
+        // Records the distances to an object, returns 'false' once all lanes have collided with something and found
+        // their target. Distances are divided by the object's Lipschitz bound, see raycast
+        auto consider = [&](sdf_object* obj, doublex4 d) {
+            d = d / doublex4(obj->lipschitz());
+            radius = select(live, vmin(radius, d), radius);
+            maskx4 closer = live & (d < min_dist);
+            min_dist = select(closer, d, min_dist);
+            hx = select(closer, px, hx);
+            hy = select(closer, py, hy);
+            hz = select(closer, pz, hz);
+
+            maskx4 hit = live & (d < threshold);
+            maskx4 chosen = hit | (choosing & (d < target_dist));
+            if (chosen.any()) {
+                for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+                    if (chosen.lane(i)) targets[i] = obj;
+                }
+                target_dist = select(chosen, d, target_dist);
+                live = andnot(live, hit);
+                active = andnot(active, hit);
+                choosing = choosing | (hit & (coarse > doublex4(0.0)));
+                if (!live.any() && !choosing.any()) return false;
+            }
+            local_min_dist = select(live, vmin(local_min_dist, d), local_min_dist);
+            return true;
+        };
+
+        if (hierarchy) {
+            accel.traverse([&](const aabb& box) {
+                               double lanes[FRAG_PACKET_SIZE];
+                               doublex4 box_dist = box.distance_x4(p);
+                               select(live, box_dist - local_min_dist,
+                                      select(choosing, box_dist - target_dist, doublex4(MAX_DIST))).store(lanes);
+                               double priority = lanes[0];
+                               for (int i = 1; i < FRAG_PACKET_SIZE; i++) priority = min(priority, lanes[i]);
+                               return priority;
+                           },
+                           [&](sdf_object* obj) {
+                               if (counters) counters->sdf_evals += FRAG_PACKET_SIZE;
+                               return consider(obj, obj->sdf_x4(p));
+                           });
+        } else {
+            if (compiled) {
+                program.eval_x4(p, dists.data());
+                if (counters) counters->sdf_evals += FRAG_PACKET_SIZE * static_cast<long>(scn->objects.size());
+            }
+            for (size_t i = 0; i < scn->objects.size(); i++) {
+                sdf_object* obj = scn->objects[i];
+                if (counters && !compiled) counters->sdf_evals += FRAG_PACKET_SIZE;
+                if (!consider(obj, compiled ? dists[i] : obj->sdf_x4(p))) break;
+            }
+        }
+
+        maskx4 failed = evaluated & (omega > doublex4(1.0)) & (radius + prev_radius < step);
+        if (failed.any()) {
+            // Lanes whose relaxed step may have skipped a surface go back to the conservative step, see raycast
+            for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+                if (!failed.lane(i)) continue;
+                targets[i] = nullptr;
+                fallbacks[i]++;
+            }
+            doublex4 safe_step = vmax(doublex4(MIN_STEP), prev_radius);
+            t = select(failed, t - step + safe_step, t);
+            step = select(failed, safe_step, step);
+            omega = select(failed, doublex4(1.0), omega);
+            min_dist = select(failed, prev_min_dist, min_dist);
+            hx = select(failed, prev_hx, hx);
+            hy = select(failed, prev_hy, hy);
+            hz = select(failed, prev_hz, hz);
+            active = active | failed;
+        }
+
+        int resumed = 0;
+        if (config.coarse_threshold > 0) {
+            maskx4 landed = andnot(evaluated, active);
+            double lanes_t[FRAG_PACKET_SIZE], lanes_coarse[FRAG_PACKET_SIZE];
+            t.store(lanes_t);
+            coarse.store(lanes_coarse);
+            for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+                if (!landed.lane(i) || lanes_coarse[i] <= 0) continue;
+                refined[i].travel = lanes_t[i];
+                if (refine_hit(rays[i], targets[i], refined[i], distance_threshold, cone_angle)) continue;
+
+                // A near miss: the lane marches on from the refined point with the fixed threshold
+                targets[i] = nullptr;
+                lanes_t[i] = refined[i].travel;
+                lanes_coarse[i] = 0;
+                resumed |= 1 << i;
+            }
+            if (resumed) {
+                t = doublex4::load(lanes_t);
+                coarse = doublex4::load(lanes_coarse);
+                prev_radius = select(maskx4::from_bits(resumed), doublex4(0.0), prev_radius);
+                step = select(maskx4::from_bits(resumed), doublex4(0.0), step);
+                active = active | maskx4::from_bits(resumed);
+            }
+        }
+
+        maskx4 advance = andnot(active, failed | maskx4::from_bits(resumed));
+        prev_radius = select(advance, local_min_dist, prev_radius);
+        step = select(advance, vmax(doublex4(MIN_STEP), omega * local_min_dist), step);
+        t = select(advance, t + step, t);
+        maskx4 out_of_range = active & (t >= max_dist);
+        travel = select(out_of_range, max_dist, travel);
+        active = andnot(active, out_of_range);
+    }
+
+    for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+        out_infos[i].hitpoint = point3(hx[i], hy[i], hz[i]);
+        out_infos[i].target = targets[i];
+        out_infos[i].min_dist = min_dist[i];
+        out_infos[i].travel = travel[i];
+        if (targets[i] != nullptr) {
+            if (config.coarse_threshold > 0 && coarse[i] > 0) {
+                out_infos[i].hitpoint = refined[i].hitpoint;
+                out_infos[i].min_dist = refined[i].min_dist;
+                out_infos[i].travel = refined[i].travel;
+            }
+            targets[i]->sdf_leaf(out_infos[i].hitpoint, out_infos[i].surface);
+        }
+        out_infos[i].steps = steps[i];
+        out_infos[i].relaxation_fallbacks = fallbacks[i];
+        out_infos[i].budget_exhausted = exhausted[i];
+    }
+}
+
+bool ray_march_shader::refine_hit(const ray& r, const sdf_object* obj, raycast_info& info, double distance_threshold,
+                                  double cone_angle) const {
+    const double inv_lipschitz = 1 / obj->lipschitz();
+    cost_counters* counters = cost_counters::counting();
+    auto distance = [&](double t) {
+        if (counters) counters->sdf_evals++;
+        return obj->sdf(r.at(t)) * inv_lipschitz;
+    };
+
+    double best_t = info.travel, best_d = distance(best_t);
+
+    // Last two samples on the same side of the surface, and the bracket [a, b] around it once a sample lands on
+    // the other side. No surface of any object lies closer to t1 than the scene distance s1
+    double t0 = best_t, d0 = best_d;
+    double t1 = best_t, d1 = best_d;
+    double s1 = scene_distance(r.at(t1));
+    bool bracketed = false;
+    double a = 0, d_a = 0, b = 0, d_b = 0;
+    int kept = 0;
+
+    for (int i = 0; i < config.refine_iterations && abs(best_d) >= distance_threshold; i++) {
+        double t;
+        double s = 0;
+        if (bracketed) {
+            t = a - d_a * (b - a) / (d_b - d_a);
+            if (!(t > min(a, b) && t < max(a, b))) t = (a + b) / 2;
+        } else {
+            // A sphere-tracing step against the whole scene never passes a surface. The secant through the last two
+            // samples gets to the object's surface faster, but may jump through a thin part of it or through another
+            // object, so it is only kept where the unbounding spheres of both ends cover it, like a relaxed step
+            const double safe = d1 > 0 ? min(d1, max(s1, 0.0)) : d1;
+            t = t1 + safe;
+            bool secant = false;
+            if (t1 > t0 && d0 > d1 && d1 > 0 && safe > 0) {
+                double guess = clamp(t1 + d1 * (t1 - t0) / (d0 - d1), t, t1 + 8 * safe);
+                secant = guess > t;
+                t = guess;
+            }
+            s = scene_distance(r.at(t));
+            if (secant && safe + abs(s) < t - t1) {
+                t = t1 + safe;
+                s = scene_distance(r.at(t));
+            }
+        }
+
+        double d = distance(t);
+        if (abs(d) < abs(best_d)) {
+            best_t = t;
+            best_d = d;
+        }
+
+        if (!bracketed) {
+            if ((d < 0) != (d1 < 0)) {
+                bracketed = true;
+                a = t1;
+                d_a = d1;
+                b = t;
+                d_b = d;
+            } else {
+                t0 = t1;
+                d0 = d1;
+                t1 = t;
+                d1 = d;
+                s1 = s;
+            }
+        } else if ((d < 0) == (d_b < 0)) {
+            // Illinois: halve the value of an end point that is kept twice in a row, so it doesn't stall
+            b = t;
+            d_b = d;
+            if (kept == 1) d_a /= 2;
+            kept = 1;
+        } else {
+            a = t;
+            d_a = d;
+            if (kept == 2) d_b /= 2;
+            kept = 2;
+        }
+    }
+
+    info.travel = best_t;
+    info.hitpoint = r.at(best_t);
+    info.min_dist = best_d;
+
+    // Rays that cross the surface or come close enough to it hit, the others only passed by
+    return bracketed || best_d < max(distance_threshold, cone_angle * best_t);
+}
+
 color ray_march_shader::frag(const vec3 &uv) {
     color col = clear_color(uv);
     ray r = cam.get_ray(uv, true);
 
-    frag_ray(raycast(r, distThreshold), col);
+    if (config.segment_tracing) {
+        frag_ray(segment_raycast(r, distThreshold, nullptr, start_distance(uv), primary_cone_angle()), col);
+    } else {
+        frag_ray(raycast(r, distThreshold, nullptr, start_distance(uv), primary_cone_angle()), col);
+    }
 
     return col;
 }
+
+
+void ray_march_shader::frag_packet(const vec3 uv[], color out_cols[]) {
+    if (!config.packet_mode || config.segment_tracing) {
+        frag_shader::frag_packet(uv, out_cols);
+        return;
+    }
+
+    ray rays[FRAG_PACKET_SIZE];
+    raycast_info infos[FRAG_PACKET_SIZE];
+    double start = MAX_DIST;
+    for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+        rays[i] = cam.get_ray(uv[i], true);
+        start = min(start, start_distance(uv[i]));
+    }
+    raycast_packet(rays, distThreshold, infos, start, primary_cone_angle());
+
+    for (int i = 0; i < FRAG_PACKET_SIZE; i++) {
+        out_cols[i] = clear_color(uv[i]);
+        frag_ray(infos[i], out_cols[i]);
+    }
+}
+
+void ray_march_shader::begin_frame(int width, int height) {
+    pixel_angle = cam.pixel_cone_angle(height);
+    frame_width = width;
+    frame_height = height;
+    if (config.prepass_block > 0) {
+        prepass();
+    } else {
+        block_starts.clear();
+    }
+}
+
+double ray_march_shader::scene_distance(const vec3& p, double stop_below) const {
+    double d = MAX_DIST;
+    cost_counters* counters = cost_counters::counting();
+    if (use_bvh()) {
+        accel.traverse([&](const aabb& box) { return box.distance(p) - d; },
+                       [&](sdf_object* obj) {
+                           if (counters) counters->sdf_evals++;
+                           d = min(d, obj->sdf(p) / obj->lipschitz());
+                           return d >= stop_below;
+                       });
+    } else if (config.compiled_scene && program.valid() && !sdf_profiler::active()) {
+        thread_local std::vector<double> dists;
+        dists.resize(program.slot_count());
+        program.eval(p, dists.data());
+        if (counters) counters->sdf_evals += static_cast<long>(scn->objects.size());
+        for (size_t i = 0; i < scn->objects.size(); i++) d = min(d, dists[i] / scn->objects[i]->lipschitz());
+    } else {
+        for (auto obj : scn->objects) {
+            if (counters) counters->sdf_evals++;
+            d = min(d, obj->sdf(p) / obj->lipschitz());
+            if (d < stop_below) break;
+        }
+    }
+    return d;
+}
+
+double ray_march_shader::light_visibility(size_t light, const ray& shadow_ray, double hardness) const {
+    if (hardness <= 0 && config.shadow_maps && light < light_shadows.size() && !light_shadows[light].empty()) {
+        double visible = light_shadows[light].visibility(shadow_ray.origin());
+        if (visible >= 0) return visible;
+    }
+    return occlusion(shadow_ray, scn->light_sources[light]->light_distance(shadow_ray.origin()), hardness);
+}
+
+void ray_march_shader::bake_shadow_maps(const shadow_map::settings& s) {
+    auto depth = [this](const ray& r) -> double {
+        raycast_info info = raycast(r, distThreshold);
+        if (info.target != nullptr) return info.travel;
+        // A ray that ran out of steps may still hit something further on
+        return info.budget_exhausted ? NAN : INFINITY;
+    };
+
+    light_shadows.clear();
+    for (auto light_src : scn->light_sources) {
+        if (light_src->directional()) {
+            light_shadows.emplace_back(light_src->light_dir(point3()), s, depth, MAX_DIST);
+        } else {
+            light_shadows.emplace_back();
+        }
+    }
+}
+
+double ray_march_shader::occlusion(const ray& r, double max_travel, double hardness) const {
+    const double end = min(max_travel, MAX_DIST);
+    const bool cached = hardness <= 0 && config.distance_cache && !cache.empty();
+    double visible = 1.0;
+
+    cost_counters* counters = cost_counters::counting();
+    double t = 0;
+    for (int step = 0; t < end; step++) {
+        // Whatever lies beyond the budget may still block the light, so hard shadows count as occluded and soft
+        // ones keep the penumbra estimate of the way so far
+        if (config.max_steps > 0 && step >= config.max_steps) return hardness > 0 ? visible : 0.0;
+        if (counters) counters->steps++;
+        vec3 p = r.at(t);
+
+        if (cached) {
+            // The lower bound is only good enough to skip empty space, not for the penumbra estimate
+            double bound = cache.lower_bound(p);
+            if (bound > cache.band()) {
+                t += bound;
+                continue;
+            }
+        }
+
+        double d = scene_distance(p, distThreshold);
+        if (d < distThreshold) return 0.0;
+        if (hardness > 0 && t > 0) {
+            visible = min(visible, hardness * d / t);
+            if (visible < distThreshold) return 0.0;
+        }
+        t += max(d, MIN_STEP);
+    }
+    return visible;
+}
+
+void ray_march_shader::prepass() {
+    const int n = block_size = config.prepass_block;
+    blocks_x = (frame_width + n - 1) / n;
+    const int blocks_y = (frame_height + n - 1) / n;
+    block_starts.assign(static_cast<size_t>(blocks_x) * blocks_y, 0.0);
+
+    // The render workers only get the frame once this is done, so the rows of blocks are spread over threads of its own
+    parallel_for(blocks_y, 0, [&](int by_begin, int by_end) {
+        for (int by = by_begin; by < by_end; by++) {
+            for (int bx = 0; bx < blocks_x; bx++) {
+                // UV coordinates of the outermost pixels of the block, computed the same way the renderer does
+                int x0 = bx * n, x1 = min(x0 + n, frame_width) - 1;
+                int y0 = by * n, y1 = min(y0 + n, frame_height) - 1;
+                double u0 = double(x0) / frame_width, u1 = double(x1) / frame_width;
+                double v0 = 1.0 - double(y0) / frame_height, v1 = 1.0 - double(y1) / frame_height;
+
+                // The cone around the center ray contains every pixel ray of the block. Ray origins and directions
+                // are affine in uv before normalization, so both deviate the most at the corners of the block
+                ray center = cam.get_ray(vec3((u0 + u1) / 2, (v0 + v1) / 2, 0), true);
+                double origin_radius = 0;
+                double spread = 0;
+                for (const vec3& uv : {vec3(u0, v0, 0), vec3(u1, v0, 0), vec3(u0, v1, 0), vec3(u1, v1, 0)}) {
+                    ray corner = cam.get_ray(uv, true);
+                    origin_radius = max(origin_radius, (corner.origin() - center.origin()).length());
+                    spread = max(spread, (corner.direction() - center.direction()).length());
+                }
+                spread *= 1.0 + 1e-9;
+
+                // Every pixel ray at travel t lies within origin_radius + spread * t of the center ray's point, so it
+                // is at least the scene distance minus that radius away from any surface
+                double t = 0;
+                for (int step = 0; t < MAX_DIST && (config.max_steps <= 0 || step < config.max_steps); step++) {
+                    double clearance = scene_distance(center.at(t)) - (origin_radius + spread * t);
+                    if (clearance < MIN_STEP) break;
+                    t += clearance;
+                }
+                block_starts[static_cast<size_t>(by) * blocks_x + bx] = min(t, MAX_DIST);
+            }
+        }
+    });
+}
+
+double ray_march_shader::start_distance(const vec3& uv) const {
+    if (block_starts.empty()) return 0.0;
+    int x = static_cast<int>(uv.x() * frame_width + 0.5);
+    int y = static_cast<int>((1.0 - uv.y()) * frame_height + 0.5);
+    x = min(max(x, 0), frame_width - 1);
+    y = min(max(y, 0), frame_height - 1);
+    return block_starts[static_cast<size_t>(y / block_size) * blocks_x + x / block_size];
+}
@@ -2,8 +2,12 @@
 #define RAYTRACING_IN_A_WEEKEND_RAY_MARCH_SHADER_H
 
 #include "frag_shader.h"
+#include "raymarch/shadow_map.h"
 #include "raymarch/camera.h"
-#include "raymarch/scene.h"
+#include "raymarch/scene_builder.h"
+#include "raymarch/sdf_program.h"
+#include "raymarch/bvh.h"
+#include "raymarch/distance_cache.h"
 
 /**
  * Information about a completed raycast:
@@ -29,6 +33,125 @@ struct raycast_info {
      * The distance travelled by the ray before colliding or going out of range
      */
     double travel {};
+
+    /**
+     * Number of march steps taken
+     */
+    int steps = 0;
+
+    /**
+     * Number of over-relaxed steps that had to be taken back because they may have skipped a surface
+     */
+    int relaxation_fallbacks = 0;
+
+    /**
+     * Whether the raycast was cut off by march_settings::max_steps before hitting anything or going out of range
+     */
+    bool budget_exhausted = false;
+
+    /**
+     * The leaf object of 'target' that owns the surface at 'hitpoint', for normal and color lookups that don't have
+     * to walk the object tree. Only set if an object was hit
+     */
+    sdf_hit surface {};
+};
+
+/**
+ * Options that select between the marching strategies of a ray_march_shader
+ */
+struct march_settings {
+    /**
+     * Whether packets of neighbouring primary rays are marched together in SIMD lanes
+     */
+    bool packet_mode = true;
+
+    /**
+     * Whether distances are evaluated through the scene's compiled sdf_program instead of walking the object trees.
+     * Ignored while the sdf_profiler is active
+     */
+    bool compiled_scene = true;
+
+    /**
+     * Scenes with at least this many top-level objects are marched through a bounding volume hierarchy, which
+     * only evaluates objects whose bounds are closer than the closest distance found so far
+     */
+    size_t bvh_min_objects = 16;
+
+    /**
+     * Whether far-field march steps use the baked distance cache, if one has been baked
+     */
+    bool distance_cache = true;
+
+    /**
+     * Over-relaxation factor of the march steps (enhanced sphere tracing, Keinert et al. 2014). 1 takes exactly
+     * the distance to the closest object; larger values step further and fall back to the conservative step
+     * whenever the unbounding spheres of two consecutive points stop overlapping. Values around 1.2 - 1.6 work well
+     */
+    double relaxation = 1.0;
+
+    /**
+     * Maximum number of march steps per ray, 0 for no limit. Primary rays that exhaust it are reported as misses.
+     * Shadow rays that exhaust it count as occluded for hard shadows and keep their penumbra estimate so far for soft
+     * shadows, rather than as lit
+     */
+    int max_steps = 1024;
+
+    /**
+     * Scale of the pixel footprint hit threshold. A ray counts as hitting a surface once it is closer than this
+     * fraction of the radius of the pixel cone at its current travel distance, but never later than at the fixed
+     * distance threshold. 0 only uses the fixed threshold
+     */
+    double footprint_scale = 0.5;
+
+    /**
+     * Hit threshold of the coarse phase of two-phase marching, 0 to disable it. Rays stop marching as soon as they
+     * come closer than this to an object, skipping the slow final approach, and the hit point is then refined along
+     * the ray on the distance of the hit object alone, down to the fixed distance threshold. Rays that turn out to
+     * only pass by the object march on with the fixed threshold, so silhouettes don't grow
+     */
+    double coarse_threshold = 0;
+
+    /**
+     * Maximum number of secant and bisection iterations that refine a hit point of the coarse phase, see
+     * coarse_threshold
+     */
+    int refine_iterations = 6;
+
+    /**
+     * Edge length in pixels of the blocks of the cone-marching prepass, 0 to disable it. Before a frame is rendered,
+     * one cone per block is marched as far as it stays clear of every surface, and the primary rays of the block
+     * start marching at that distance instead of at the camera
+     */
+    int prepass_block = 8;
+
+    /**
+     * Whether primary rays are marched with segment tracing (Galin et al. 2020) instead of sphere tracing. Every step
+     * asks the objects for a bound of their slope along the next segment of the ray and steps as far as that bound
+     * allows, which is much further than the distance wherever the ray runs along a surface, e.g. at grazing angles
+     * over large planes. Segment tracing evaluates the object trees directly, one ray at a time
+     */
+    bool segment_tracing = false;
+
+    /**
+     * Growth factor of the segments of segment tracing: the next step is searched on a segment this many times as
+     * long as the last step
+     */
+    double segment_growth = 2;
+
+    /**
+     * Whether shadows get a soft penumbra, estimated from how closely shadow rays pass by objects
+     */
+    bool soft_shadows = false;
+
+    /**
+     * Sharpness of soft shadows. Larger values give narrower penumbras
+     */
+    double shadow_hardness = 16;
+
+    /**
+     * Whether hard shadows of directional lights are looked up in the baked shadow maps, if any have been baked
+     */
+    bool shadow_maps = true;
 };
 
 /**
@@ -36,8 +159,31 @@ struct raycast_info {
  */
 class ray_march_shader : public frag_shader {
 public:
-    ray_march_shader(const scene& _scn) : scn(_scn) {}
+    /**
+     * @param _scn Scene to be rendered. Shared with the caller and any other shader, it must not change afterwards
+     */
+    explicit ray_march_shader(std::shared_ptr<const scene> _scn) : scn(std::move(_scn)),
+        program(sdf_program::compile(scn->objects)), accel(scn->objects) {}
     color frag(const vec3 &uv) override;
+    void frag_packet(const vec3 uv[], color out_cols[]) override;
+    void begin_frame(int width, int height) override;
+
+    /**
+     * Precomputes the distance field of the scene for faster marching through empty space. Must be called again
+     * whenever the scene changes
+     * @param s Bake parameters
+     */
+    void bake_distance_cache(const distance_cache::settings& s) { cache = distance_cache(scn->objects, s); }
+
+    /**
+     * Precomputes the shadows of all directional light sources of the scene. Must be called again whenever the
+     * scene changes
+     * @param s Bake parameters
+     */
+    void bake_shadow_maps(const shadow_map::settings& s);
+
+    march_settings& settings() { return config; }
+    const march_settings& settings() const { return config; }
 
 protected:
     virtual void frag_ray(raycast_info r_info, color& out_col) = 0;
@@ -45,9 +191,99 @@ protected:
      * Performs a raycast to probe information about the scene
      * @param r Ray to be cast
      * @param ignore Pointer to an sdf_object that will not be considered in the raycast
+     * @param min_travel Distance from the ray origin at which marching starts
+     * @param cone_angle Growth of the hit threshold per unit of travel, see primary_cone_angle()
      * @return Information about the completed raycast
      */
-    raycast_info raycast(const ray& r, double distance_threshold, sdf_object* ignore = nullptr, double min_travel = 0.0) const;
+    raycast_info raycast(const ray& r, double distance_threshold, sdf_object* ignore = nullptr, double min_travel = 0.0,
+                         double cone_angle = 0.0) const;
+
+    /**
+     * Performs FRAG_PACKET_SIZE raycasts at once. Each ray gets its own travel distance and retires from the packet
+     * when it hits an object or goes out of range; the results are identical to calling raycast for every ray
+     * @param rays Rays to be cast
+     * @param distance_threshold Distance below which a ray counts as colliding with an object
+     * @param out_infos Receives the information about each completed raycast
+     * @param min_travel Distance from the ray origins at which marching starts
+     * @param cone_angle Growth of the hit threshold per unit of travel, see primary_cone_angle()
+     */
+    void raycast_packet(const ray rays[], double distance_threshold, raycast_info out_infos[],
+                        double min_travel = 0.0, double cone_angle = 0.0) const;
+
+    /**
+     * Performs a raycast with segment tracing, see march_settings::segment_tracing. Takes the same parameters and
+     * gives the same information as raycast
+     */
+    raycast_info segment_raycast(const ray& r, double distance_threshold, sdf_object* ignore = nullptr,
+                                 double min_travel = 0.0, double cone_angle = 0.0) const;
+
+    /**
+     * Moves the hit point of a ray that stopped at the coarse threshold onto the surface of the hit object. Starts
+     * with a sphere-tracing step against the whole scene, continues with secant steps along the ray that are only
+     * kept if they can't have skipped a surface, and switches to regula falsi (Illinois variant) once a step lands
+     * inside the object
+     * @param r Ray that hit the object
+     * @param obj Object that was hit, the closest one below the coarse threshold
+     * @param info Raycast information with the coarse hit. Its travel, hitpoint and min_dist are updated
+     * @param distance_threshold Distance below which the hit point is accurate enough
+     * @param cone_angle Growth of the hit threshold per unit of travel, see raycast
+     * @return Whether the ray really hits the object. 'false' if it only passes by closer than the coarse threshold
+     */
+    bool refine_hit(const ray& r, const sdf_object* obj, raycast_info& info, double distance_threshold,
+                    double cone_angle) const;
+
+    /**
+     * @return Hit threshold growth per unit of travel for camera rays: the scaled pixel cone angle of the current
+     * resolution. Secondary rays have no pixel footprint and use the fixed threshold only
+     */
+    double primary_cone_angle() const { return config.footprint_scale * pixel_angle; }
+
+    /**
+     * Checks how much of a light source is visible along a shadow ray. Marching stops at the first blocker or once
+     * the ray passes the light source. With a hardness above 0 the closest approach to any object along the way
+     * is turned into a penumbra factor min(hardness * d / t), so soft shadows cost a single march
+     * @param r Ray from the shaded point towards the light source
+     * @param max_travel Distance to the light source
+     * @param hardness Sharpness of the penumbra, 0 for hard shadows
+     * @return Visible fraction of the light, from 0 (fully occluded) to 1 (unoccluded). Hard shadows only give 0 or 1.
+     * Rays that exhaust march_settings::max_steps don't count as unoccluded, see there
+     */
+    double occlusion(const ray& r, double max_travel, double hardness = 0.0) const;
+
+    /**
+     * Checks how much of a light source of the scene is visible from the origin of a shadow ray. Hard shadows of
+     * directional lights are looked up in the baked shadow map where possible, everything else is marched through
+     * occlusion()
+     * @param light Index of the light source in the scene
+     * @param shadow_ray Ray from the shaded point towards the light source
+     * @param hardness Sharpness of the penumbra, 0 for hard shadows
+     * @return Visible fraction of the light, see occlusion()
+     */
+    double light_visibility(size_t light, const ray& shadow_ray, double hardness = 0.0) const;
+
+    /**
+     * @return Whether raycasts go through the bounding volume hierarchy
+     */
+    bool use_bvh() const { return scn->objects.size() >= config.bvh_min_objects && accel.bounded_count() > 0; }
+
+    /**
+     * @param p Point in world space
+     * @param stop_below Evaluation stops early once an object closer than this is found
+     * @return Distance from p to the closest object of the scene, or to an object closer than stop_below
+     */
+    double scene_distance(const vec3& p, double stop_below = -MAX_DIST) const;
+
+    /**
+     * Marches one cone per block of pixels and records how far the primary rays of each block can start. The rows of
+     * blocks are marched in parallel
+     */
+    void prepass();
+
+    /**
+     * @param uv UV viewport coordinate of a pixel of the current frame
+     * @return Travel distance at which the primary ray of the pixel starts marching
+     */
+    double start_distance(const vec3& uv) const;
 
 protected:
     static constexpr double MAX_DIST = 30;
@@ -55,7 +291,31 @@ protected:
     double distThreshold = 0.00005;
 
     camera cam = camera(vec3(), 2.0, 16.0 / 9.0, 1.0);
-    scene scn;
+    std::shared_ptr<const scene> scn;
+    sdf_program program;
+    bvh accel;
+    distance_cache cache;
+    march_settings config;
+
+    /**
+     * Baked shadow maps by light source index. Empty for lights that aren't directional
+     */
+    std::vector<shadow_map> light_shadows;
+
+    /**
+     * Pixel cone angle of the current resolution, 0 until begin_frame is called
+     */
+    double pixel_angle = 0;
+
+    int frame_width = 0;
+    int frame_height = 0;
+
+    /**
+     * Start distances of the primary rays per prepass block, in row-major order. Empty if the prepass is disabled
+     */
+    std::vector<double> block_starts;
+    int block_size = 0;
+    int blocks_x = 0;
 };
 
 #endif //RAYTRACING_IN_A_WEEKEND_RAY_MARCH_SHADER_H
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include "bvh.h"
+
+bvh::bvh(const std::vector<sdf_object*>& objects) {
+    std::vector<item> items;
+    for (auto obj : objects) {
+        aabb box = obj->bounds();
+        if (box.bounded() && !box.empty()) items.push_back(item{obj, box, box.center()});
+        else unbounded.push_back(obj);
+    }
+    if (items.empty()) return;
+
+    nodes.reserve(2 * items.size() / LEAF_SIZE + 1);
+    build(items, 0, static_cast<int>(items.size()));
+    for (auto& it : items) leaves.push_back(it.obj);
+}
+
+int bvh::build(std::vector<item>& items, int begin, int end) {
+    int index = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+
+    aabb box;
+    aabb centers;
+    for (int i = begin; i < end; i++) {
+        box = aabb::merge(box, items[i].box);
+        centers = aabb::merge(centers, aabb(items[i].center, items[i].center));
+    }
+    nodes[index].box = box;
+
+    if (end - begin <= LEAF_SIZE) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return index;
+    }
+
+    int axis = centers.longest_axis();
+    int mid = begin + (end - begin) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                     [axis](const item& a, const item& b) { return a.center[axis] < b.center[axis]; });
+
+    int left = build(items, begin, mid);
+    int right = build(items, mid, end);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
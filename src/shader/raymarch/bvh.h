@@ -0,0 +1,103 @@
+#ifndef CPU_RAYMARCHER_BVH_H
+#define CPU_RAYMARCHER_BVH_H
+
+#include <vector>
+#include "objects.h"
+
+/**
+ * Bounding volume hierarchy over a list of sdf_objects, used to find the closest objects to a point without
+ * evaluating every object's distance function. Objects without finite bounds (e.g. ground planes) are kept in a
+ * separate list that is visited on every query
+ */
+class bvh {
+public:
+    /**
+     * Maximum number of objects in a leaf node
+     */
+    static constexpr int LEAF_SIZE = 4;
+
+    bvh() = default;
+
+    /**
+     * Builds the hierarchy by recursively splitting the objects at the median of their box centers along the
+     * longest axis
+     * @param objects Objects to be contained in the hierarchy, usually scene::objects
+     */
+    explicit bvh(const std::vector<sdf_object*>& objects);
+
+    /**
+     * Visits the objects of the hierarchy, nearest nodes first. Unbounded objects are always visited first. A node
+     * is descended into only while the priority of its bounding box is negative, so a caller that tracks the best
+     * distance found so far can prune everything that can't beat it
+     * @param priority Function (const aabb&) -> double. Typically the distance from the query point to the box
+     * minus the best distance found so far
+     * @param visit Function (sdf_object*) -> bool. Returning 'false' ends the traversal
+     */
+    template<typename priority_fn, typename visit_fn>
+    void traverse(priority_fn&& priority, visit_fn&& visit) const {
+        for (auto obj : unbounded) {
+            if (!visit(obj)) return;
+        }
+        if (nodes.empty()) return;
+
+        int stack[STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const node& n = nodes[stack[--sp]];
+            if (priority(n.box) >= 0) continue;
+
+            if (n.count > 0) {
+                for (int i = n.first; i < n.first + n.count; i++) {
+                    if (!visit(leaves[i])) return;
+                }
+                continue;
+            }
+
+            // Push the farther child first so that the nearer one is visited first
+            double pl = priority(nodes[n.left].box);
+            double pr = priority(nodes[n.right].box);
+            int near = pl <= pr ? n.left : n.right;
+            int far = pl <= pr ? n.right : n.left;
+            if ((pl <= pr ? pr : pl) < 0) stack[sp++] = far;
+            if ((pl <= pr ? pl : pr) < 0) stack[sp++] = near;
+        }
+    }
+
+    /**
+     * @return Bounding box of all bounded objects
+     */
+    aabb bounds() const { return nodes.empty() ? aabb() : nodes[0].box; }
+
+    /**
+     * @return Number of objects with finite bounds
+     */
+    size_t bounded_count() const { return leaves.size(); }
+
+private:
+    static constexpr int STACK_SIZE = 64;
+
+    /**
+     * Node of the hierarchy. Inner nodes reference their children, leaf nodes a range of 'leaves'
+     */
+    struct node {
+        aabb box;
+        int left = -1, right = -1;
+        int first = 0, count = 0;
+    };
+
+    struct item {
+        sdf_object* obj;
+        aabb box;
+        point3 center;
+    };
+
+    int build(std::vector<item>& items, int begin, int end);
+
+private:
+    std::vector<node> nodes;
+    std::vector<sdf_object*> leaves;
+    std::vector<sdf_object*> unbounded;
+};
+
+#endif //CPU_RAYMARCHER_BVH_H
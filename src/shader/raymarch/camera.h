@@ -36,7 +36,7 @@ public:
      * @return The created ray
      */
     ray get_ray(const vec3& uv, bool normalized) const {
-        double origin_height = viewport_height * 0.7;
+        double origin_height = viewport_height * ORIGIN_SCALE;
         double origin_width = origin_height * viewport_width / viewport_height;
         vec3 origin_hor = vec3(origin_width, 0, 0);
         vec3 origin_ver = vec3(0, origin_height, 0);
@@ -49,7 +49,23 @@ public:
         return ray(ray_origin, dir);
     }
 
+    /**
+     * Returns the angle by which the rays of two vertically adjacent pixels diverge, i.e. the opening angle of the
+     * cone of space that a single pixel covers
+     * @param image_height Height of the rendered image in pixels
+     * @return Pixel cone angle in radians
+     */
+    double pixel_cone_angle(int image_height) const {
+        // Ray origins move along with the viewport position, only the remaining part of it widens the cone
+        return (1.0 - ORIGIN_SCALE) * viewport_height / (focal_length * image_height);
+    }
+
 private:
+    /**
+     * Size of the plane the ray origins are spread over, relative to the viewport
+     */
+    static constexpr double ORIGIN_SCALE = 0.7;
+
     double viewport_width;
     double viewport_height;
     double focal_length;
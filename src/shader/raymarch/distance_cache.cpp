@@ -0,0 +1,122 @@
+#include "../../util/parallel.h"
+#include "distance_cache.h"
+
+/**
+ * Distance to the closest of a list of objects, scaled by their Lipschitz bounds so it never exceeds the true distance
+ */
+static double scene_sdf(const std::vector<sdf_object*>& objects, const vec3& p) {
+    double d = std::numeric_limits<double>::infinity();
+    for (auto obj : objects) d = min(d, obj->sdf(p) / obj->lipschitz());
+    return d;
+}
+
+/**
+ * Trilinear interpolation between the eight corners of a cell
+ */
+static double trilinear(double c000, double c100, double c010, double c110,
+                        double c001, double c101, double c011, double c111, double fx, double fy, double fz) {
+    double c00 = lerp(c000, c100, fx);
+    double c10 = lerp(c010, c110, fx);
+    double c01 = lerp(c001, c101, fx);
+    double c11 = lerp(c011, c111, fx);
+    return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+}
+
+distance_cache::distance_cache(const std::vector<sdf_object*>& objects, const settings& s)
+    : origin(s.region.min_corner()), voxel_size(s.voxel_size), brick_size(max(1, s.brick_size)) {
+    if (!s.region.bounded() || s.region.empty() || voxel_size <= 0) return;
+
+    brick_length = voxel_size * brick_size;
+    vec3 extent = s.region.extent();
+    nx = max(1, static_cast<int>(std::ceil(extent.x() / brick_length)));
+    ny = max(1, static_cast<int>(std::ceil(extent.y() / brick_length)));
+    nz = max(1, static_cast<int>(std::ceil(extent.z() / brick_length)));
+
+    // Interpolation error bounds of both grid levels, including the rounding to float
+    coarse_margin = brick_length * sqrt(3.0) + 1e-5;
+    fine_margin = voxel_size * sqrt(3.0) + 1e-5;
+    near_band = 2 * fine_margin;
+
+    // Coarse samples at all brick corners
+    coarse.resize(static_cast<size_t>(nx + 1) * (ny + 1) * (nz + 1));
+    parallel_for(nz + 1, s.threads, [&](int z_begin, int z_end) {
+        for (int z = z_begin; z < z_end; z++) {
+            for (int y = 0; y <= ny; y++) {
+                for (int x = 0; x <= nx; x++) {
+                    vec3 p = origin + brick_length * vec3(x, y, z);
+                    coarse[coarse_index(x, y, z)] = static_cast<float>(scene_sdf(objects, p));
+                }
+            }
+        }
+    });
+
+    // Bricks whose center is close enough to a surface get full-resolution voxels
+    double half_diagonal = 0.5 * brick_length * sqrt(3.0);
+    bricks.assign(static_cast<size_t>(nx) * ny * nz, -1);
+    std::vector<int> near_bricks;
+    for (int z = 0; z < nz; z++) {
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                vec3 center = origin + brick_length * vec3(x + 0.5, y + 0.5, z + 0.5);
+                if (abs(scene_sdf(objects, center)) < half_diagonal + coarse_margin) {
+                    size_t index = (static_cast<size_t>(z) * ny + y) * nx + x;
+                    bricks[index] = static_cast<int>(near_bricks.size());
+                    near_bricks.push_back(static_cast<int>(index));
+                }
+            }
+        }
+    }
+
+    int n = brick_size + 1;
+    fine.resize(near_bricks.size() * n * n * n);
+    parallel_for(static_cast<int>(near_bricks.size()), s.threads, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            int index = near_bricks[b];
+            int bx = index % nx;
+            int by = (index / nx) % ny;
+            int bz = index / (nx * ny);
+            point3 brick_origin = origin + brick_length * vec3(bx, by, bz);
+            for (int z = 0; z < n; z++) {
+                for (int y = 0; y < n; y++) {
+                    for (int x = 0; x < n; x++) {
+                        vec3 p = brick_origin + voxel_size * vec3(x, y, z);
+                        fine[brick_offset(b, x, y, z)] = static_cast<float>(scene_sdf(objects, p));
+                    }
+                }
+            }
+        }
+    });
+}
+
+double distance_cache::lower_bound(const vec3& p) const {
+    vec3 local = (p - origin) / brick_length;
+    if (!(local.x() >= 0 && local.y() >= 0 && local.z() >= 0 && local.x() < nx && local.y() < ny && local.z() < nz)) {
+        return -std::numeric_limits<double>::infinity();
+    }
+
+    int bx = static_cast<int>(local.x());
+    int by = static_cast<int>(local.y());
+    int bz = static_cast<int>(local.z());
+    double fx = local.x() - bx;
+    double fy = local.y() - by;
+    double fz = local.z() - bz;
+
+    int brick = bricks[(static_cast<size_t>(bz) * ny + by) * nx + bx];
+    if (brick < 0) {
+        return trilinear(coarse[coarse_index(bx, by, bz)], coarse[coarse_index(bx + 1, by, bz)],
+                         coarse[coarse_index(bx, by + 1, bz)], coarse[coarse_index(bx + 1, by + 1, bz)],
+                         coarse[coarse_index(bx, by, bz + 1)], coarse[coarse_index(bx + 1, by, bz + 1)],
+                         coarse[coarse_index(bx, by + 1, bz + 1)], coarse[coarse_index(bx + 1, by + 1, bz + 1)],
+                         fx, fy, fz) - coarse_margin;
+    }
+
+    double vx = fx * brick_size, vy = fy * brick_size, vz = fz * brick_size;
+    int x = min(static_cast<int>(vx), brick_size - 1);
+    int y = min(static_cast<int>(vy), brick_size - 1);
+    int z = min(static_cast<int>(vz), brick_size - 1);
+    return trilinear(fine[brick_offset(brick, x, y, z)], fine[brick_offset(brick, x + 1, y, z)],
+                     fine[brick_offset(brick, x, y + 1, z)], fine[brick_offset(brick, x + 1, y + 1, z)],
+                     fine[brick_offset(brick, x, y, z + 1)], fine[brick_offset(brick, x + 1, y, z + 1)],
+                     fine[brick_offset(brick, x, y + 1, z + 1)], fine[brick_offset(brick, x + 1, y + 1, z + 1)],
+                     vx - x, vy - y, vz - z) - fine_margin;
+}
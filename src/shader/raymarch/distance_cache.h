@@ -0,0 +1,101 @@
+#ifndef CPU_RAYMARCHER_DISTANCE_CACHE_H
+#define CPU_RAYMARCHER_DISTANCE_CACHE_H
+
+#include <vector>
+#include "objects.h"
+
+/**
+ * Sparse, precomputed distance field of a static scene. The baked region is split into a coarse grid of bricks. The
+ * distance is sampled at every brick corner, and bricks close to a surface additionally store a full-resolution
+ * voxel grid. Lookups interpolate trilinearly and subtract the interpolation error bound of the grid they used, so
+ * the result is always a lower bound of the true scene distance and can be used as a safe march step
+ */
+class distance_cache {
+public:
+    /**
+     * Bake parameters
+     */
+    struct settings {
+        /**
+         * Region of space to be baked. Lookups outside of it report no information
+         */
+        aabb region;
+
+        /**
+         * Edge length of a full-resolution voxel
+         */
+        double voxel_size = 0.05;
+
+        /**
+         * Number of voxels along each edge of a brick
+         */
+        int brick_size = 8;
+
+        /**
+         * Number of bake threads. Values below 1 select std::thread::hardware_concurrency()
+         */
+        int threads = 0;
+    };
+
+    distance_cache() = default;
+
+    /**
+     * Bakes the distance field of a list of objects
+     * @param objects Objects whose minimum distance is baked, usually scene::objects
+     * @param s Bake parameters
+     */
+    distance_cache(const std::vector<sdf_object*>& objects, const settings& s);
+
+    /**
+     * @return Whether nothing has been baked
+     */
+    bool empty() const { return coarse.empty(); }
+
+    /**
+     * Looks up a lower bound of the scene distance
+     * @param p Point in world space
+     * @return Value that never exceeds the distance from p to the closest object, or negative infinity if p lies
+     * outside of the baked region
+     */
+    double lower_bound(const vec3& p) const;
+
+    /**
+     * @return Lower bounds below this distance are too close to a surface to be worth using, the exact distance
+     * functions should be evaluated instead
+     */
+    double band() const { return near_band; }
+
+    /**
+     * @return Number of bytes occupied by the baked samples
+     */
+    size_t memory_usage() const {
+        return (coarse.size() + fine.size()) * sizeof(float) + bricks.size() * sizeof(int);
+    }
+
+private:
+    size_t coarse_index(int x, int y, int z) const {
+        return (static_cast<size_t>(z) * (ny + 1) + y) * (nx + 1) + x;
+    }
+
+    size_t brick_offset(int brick, int x, int y, int z) const {
+        int n = brick_size + 1;
+        return static_cast<size_t>(brick) * n * n * n + (static_cast<size_t>(z) * n + y) * n + x;
+    }
+
+private:
+    point3 origin;
+    double voxel_size = 0;
+    double brick_length = 0;
+    int brick_size = 0;
+    int nx = 0, ny = 0, nz = 0;
+
+    double coarse_margin = 0;
+    double fine_margin = 0;
+    double near_band = 0;
+
+    std::vector<float> coarse;
+    std::vector<int> bricks;
+    std::vector<float> fine;
+};
+
+#endif //CPU_RAYMARCHER_DISTANCE_CACHE_H
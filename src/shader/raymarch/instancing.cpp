@@ -0,0 +1,77 @@
+#include <algorithm>
+#include "instancing.h"
+
+sdf_instances::sdf_instances(sdf_object* _obj, std::vector<vec3> positions)
+    : sdf_instancing(_obj), points(std::move(positions)), split_axes(points.size(), 0), box(aabb()) {
+    aabb child = obj->bounds();
+    radius = 0;
+    for (int corner = 0; corner < 8; corner++) {
+        vec3 c((corner & 1) ? child.max_corner().x() : child.min_corner().x(),
+               (corner & 2) ? child.max_corner().y() : child.min_corner().y(),
+               (corner & 4) ? child.max_corner().z() : child.min_corner().z());
+        radius = max(radius, c.length());
+    }
+    for (const auto& pos : points) box = aabb::merge(box, child.translated(pos));
+
+    build(0, points.size());
+}
+
+void sdf_instances::build(size_t begin, size_t end) {
+    if (end - begin < 2) return;
+
+    aabb range;
+    for (size_t i = begin; i < end; i++) range = aabb::merge(range, aabb(points[i], points[i]));
+    int axis = range.longest_axis();
+
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(points.begin() + begin, points.begin() + mid, points.begin() + end,
+                     [axis](const vec3& a, const vec3& b) { return a[axis] < b[axis]; });
+    split_axes[mid] = static_cast<unsigned char>(axis);
+
+    build(begin, mid);
+    build(mid + 1, end);
+}
+
+void sdf_instances::nearest(const vec3& p, size_t begin, size_t end, size_t& best, double& best_d2,
+                            double& second_d2) const {
+    if (begin >= end) return;
+    size_t mid = begin + (end - begin) / 2;
+
+    double d2 = (p - points[mid]).length_squared();
+    if (d2 < best_d2) {
+        second_d2 = best_d2;
+        best_d2 = d2;
+        best = mid;
+    } else if (d2 < second_d2) {
+        second_d2 = d2;
+    }
+    if (end - begin == 1) return;
+
+    // Descend into the side of the split plane that contains p first, the other side only if it can still hold
+    // one of the two closest positions
+    int axis = split_axes[mid];
+    double offset = p[axis] - points[mid][axis];
+    if (offset < 0) {
+        nearest(p, begin, mid, best, best_d2, second_d2);
+        if (offset * offset < second_d2) nearest(p, mid + 1, end, best, best_d2, second_d2);
+    } else {
+        nearest(p, mid + 1, end, best, best_d2, second_d2);
+        if (offset * offset < second_d2) nearest(p, begin, mid, best, best_d2, second_d2);
+    }
+}
+
+double sdf_instances::fold(const vec3& p, vec3& q) const {
+    if (points.empty()) {
+        // No copies at all: a point far outside of the child keeps it out of reach of every ray
+        q = vec3(1e9 + radius, 0, 0);
+        return INFINITY;
+    }
+
+    size_t best = 0;
+    double best_d2 = INFINITY, second_d2 = INFINITY;
+    nearest(p, 0, points.size(), best, best_d2, second_d2);
+
+    // Every other copy lies within 'radius' of a position at least as far away as the second closest one
+    q = p - points[best];
+    return sqrt(second_d2) - radius;
+}
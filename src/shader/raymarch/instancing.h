@@ -0,0 +1,358 @@
+#ifndef CPU_RAYMARCHER_INSTANCING_H
+#define CPU_RAYMARCHER_INSTANCING_H
+
+#include <vector>
+#include "objects.h"
+
+/**
+ * Base of nodes that make a single child object appear many times by folding space: every point is mapped into the
+ * space of the copy closest to it, so any number of copies costs one evaluation of the child. The distance is
+ * additionally clamped to a lower bound of the distance to all other copies, which keeps it safe for marching as
+ * long as the child fits into its repetition cell. The bound is scaled by the child's Lipschitz bound, so it doesn't
+ * shorten the steps any further than the child itself
+ */
+class sdf_instancing : public sdf_object {
+public:
+    explicit sdf_instancing(sdf_object* _obj) : obj(_obj) {
+        lipschitz_bound = obj->lipschitz();
+    }
+
+    double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        vec3 q;
+        double others = fold(p, q);
+        return min(obj->sdf(q), lipschitz_bound * others);
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        vec3x4 q;
+        doublex4 others = fold_x4(p, q);
+        return vmin(obj->sdf_x4(q), doublex4(lipschitz_bound) * others);
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 q;
+        double others = fold(p, q);
+        double d = obj->sdf_grad(q, grad);
+        grad = unfold(p, grad);
+        return min(d, lipschitz_bound * others);
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        vec3 q;
+        double others = fold(p, q);
+        double d = obj->sdf_leaf(q, hit);
+        for (auto& axis : hit.axes) axis = unfold(p, axis);
+        return min(d, lipschitz_bound * others);
+    }
+
+    vec3 normal(const vec3& p) const override {
+        vec3 grad;
+        sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+    color get_diffuse_color(point3& p) const override {
+        vec3 q;
+        fold(p, q);
+        return obj->get_diffuse_color(q);
+    }
+
+    void disown_children() override { owns_children = false; }
+
+    ~sdf_instancing() {
+        if (owns_children) delete obj;
+    }
+
+protected:
+    /**
+     * Maps a point into the space of the copy of the child that is closest to it
+     * @param p Point in the node's parent space
+     * @param q Receives the point in the child's space
+     * @return Lower bound of the distance from p to all other copies
+     */
+    virtual double fold(const vec3& p, vec3& q) const = 0;
+
+    /**
+     * Folds four points at once, see fold. This default implementation folds each lane on its own, the child is
+     * still evaluated for all four lanes with a single sdf_x4 call
+     * @param p Points in the node's parent space
+     * @param q Receives the points in the child's space
+     * @return Lower bounds of the distances from the points to all other copies
+     */
+    virtual doublex4 fold_x4(const vec3x4& p, vec3x4& q) const {
+        vec3 folded[4];
+        double others[4];
+        for (int i = 0; i < 4; i++) others[i] = fold(p.lane(i), folded[i]);
+        q = vec3x4(folded[0], folded[1], folded[2], folded[3]);
+        return doublex4::load(others);
+    }
+
+    /**
+     * Maps a direction in the child's space back into the node's parent space
+     * @param p Point in the node's parent space that selects the copy, see fold
+     * @param v Direction in the child's space
+     * @return Direction in the node's parent space
+     */
+    virtual vec3 unfold(const vec3& /*p*/, const vec3& v) const { return v; }
+
+protected:
+    sdf_object* obj;
+    bool owns_children = true;
+};
+
+/**
+ * Repeats a child object along a grid. The child is centered around the origin of its cell and must fit into it
+ */
+class sdf_repeat : public sdf_instancing {
+public:
+    /**
+     * @param _obj Child object
+     * @param _spacing Distance between neighbouring copies along each axis, 0 for no repetition along an axis
+     * @param _limit Number of copies on either side of the center copy along each axis, infinite by default
+     */
+    sdf_repeat(sdf_object* _obj, const vec3& _spacing, const vec3& _limit = vec3(INFINITY))
+        : sdf_instancing(_obj), spacing(_spacing), limit(_limit) {
+        // Distance between the child's bounds and the faces of its cell, which no copy comes closer to
+        aabb child = obj->bounds();
+        margin = INFINITY;
+        for (int i = 0; i < 3; i++) {
+            if (spacing[i] <= 0) continue;
+            margin = min(margin, min(spacing[i] / 2 - child.max_corner()[i], spacing[i] / 2 + child.min_corner()[i]));
+        }
+        if (!(margin > 0)) margin = 0;
+    }
+
+    aabb bounds() const override {
+        aabb child = obj->bounds();
+        vec3 lo = child.min_corner(), hi = child.max_corner();
+        for (int i = 0; i < 3; i++) {
+            if (spacing[i] <= 0) continue;
+            lo[i] -= spacing[i] * limit[i];
+            hi[i] += spacing[i] * limit[i];
+        }
+        return aabb(lo, hi);
+    }
+
+protected:
+    double fold(const vec3& p, vec3& q) const override {
+        q = p;
+        double boundary = INFINITY;
+        for (int i = 0; i < 3; i++) {
+            if (spacing[i] <= 0) continue;
+            double cell = clamp(std::round(p[i] / spacing[i]), -limit[i], limit[i]);
+            q[i] = p[i] - spacing[i] * cell;
+            // Only faces shared with another cell lead to other copies
+            if (cell < limit[i]) boundary = min(boundary, spacing[i] / 2 - q[i]);
+            if (cell > -limit[i]) boundary = min(boundary, spacing[i] / 2 + q[i]);
+        }
+        return boundary + margin;
+    }
+
+    doublex4 fold_x4(const vec3x4& p, vec3x4& q) const override {
+        doublex4 coords[3] = {p.x(), p.y(), p.z()};
+        doublex4 boundary(INFINITY);
+        for (int i = 0; i < 3; i++) {
+            if (spacing[i] <= 0) continue;
+            doublex4 s(spacing[i]), half(spacing[i] / 2), lim(limit[i]);
+            doublex4 cell = vclamp(vround(coords[i] / s), -lim, lim);
+            coords[i] = coords[i] - s * cell;
+            boundary = select(cell < lim, vmin(boundary, half - coords[i]), boundary);
+            boundary = select(cell > -lim, vmin(boundary, half + coords[i]), boundary);
+        }
+        q = vec3x4(coords[0], coords[1], coords[2]);
+        return boundary + doublex4(margin);
+    }
+
+private:
+    vec3 spacing;
+    vec3 limit;
+    double margin;
+};
+
+/**
+ * Mirrors a child object at the planes through the origin that are perpendicular to the selected axes. The child
+ * must lie on the positive side of all of these planes, then the result is exact
+ */
+class sdf_mirror : public sdf_instancing {
+public:
+    /**
+     * @param _obj Child object
+     * @param _axes 1 for every axis that is mirrored, 0 otherwise, e.g. vec3(1, 0, 1) for four copies
+     */
+    sdf_mirror(sdf_object* _obj, const vec3& _axes) : sdf_instancing(_obj), axes(_axes) {}
+
+    aabb bounds() const override {
+        aabb child = obj->bounds();
+        vec3 lo = child.min_corner(), hi = child.max_corner();
+        for (int i = 0; i < 3; i++) {
+            if (axes[i] == 0) continue;
+            double l = lo[i], h = hi[i];
+            lo[i] = min(l, -h);
+            hi[i] = max(h, -l);
+        }
+        return aabb(lo, hi);
+    }
+
+protected:
+    double fold(const vec3& p, vec3& q) const override {
+        q = p;
+        for (int i = 0; i < 3; i++) {
+            if (axes[i] != 0) q[i] = abs(p[i]);
+        }
+        return INFINITY;
+    }
+
+    doublex4 fold_x4(const vec3x4& p, vec3x4& q) const override {
+        q = vec3x4(axes.x() != 0 ? vabs(p.x()) : p.x(),
+                   axes.y() != 0 ? vabs(p.y()) : p.y(),
+                   axes.z() != 0 ? vabs(p.z()) : p.z());
+        return doublex4(INFINITY);
+    }
+
+    vec3 unfold(const vec3& p, const vec3& v) const override {
+        vec3 u = v;
+        for (int i = 0; i < 3; i++) {
+            if (axes[i] != 0 && p[i] < 0) u[i] = -v[i];
+        }
+        return u;
+    }
+
+private:
+    vec3 axes;
+};
+
+/**
+ * Repeats a child object in a circle around the y axis. The child is placed around the positive x axis and must fit
+ * into the wedge of 360 / count degrees around it
+ */
+class sdf_polar : public sdf_instancing {
+public:
+    /**
+     * @param _obj Child object
+     * @param _count Number of copies
+     */
+    sdf_polar(sdf_object* _obj, int _count) : sdf_instancing(_obj), count(max(1, _count)),
+        sector(2 * M_PI / max(1, _count)), half_sin(std::sin(sector / 2)), half_cos(std::cos(sector / 2)) {
+        for (int i = 0; i < count; i++) {
+            copy_sin.push_back(std::sin(sector * i));
+            copy_cos.push_back(std::cos(sector * i));
+        }
+    }
+
+    aabb bounds() const override {
+        aabb child = obj->bounds();
+        if (!child.bounded()) return aabb::infinite();
+        double r = 0;
+        for (double x : {child.min_corner().x(), child.max_corner().x()}) {
+            for (double z : {child.min_corner().z(), child.max_corner().z()}) r = max(r, sqrt(x * x + z * z));
+        }
+        return aabb(vec3(-r, child.min_corner().y(), -r), vec3(r, child.max_corner().y(), r));
+    }
+
+protected:
+    double fold(const vec3& p, vec3& q) const override {
+        double angle = copy_angle(p);
+        q = rotate(p, -angle);
+        if (count == 1) return INFINITY;
+
+        // Distance to the planes through the y axis that bound the wedge
+        return min(abs(half_cos * q.z() - half_sin * q.x()), abs(half_cos * q.z() + half_sin * q.x()));
+    }
+
+    doublex4 fold_x4(const vec3x4& p, vec3x4& q) const override {
+        // The rotation of each lane's copy is looked up by its index instead of evaluating sin and cos
+        double index[4], s[4], c[4];
+        vround(vatan2(p.z(), p.x()) / doublex4(sector)).store(index);
+        for (int i = 0; i < 4; i++) {
+            int k = static_cast<int>(index[i]) % count;
+            if (k < 0) k += count;
+            s[i] = copy_sin[k];
+            c[i] = copy_cos[k];
+        }
+        doublex4 sin_x4 = doublex4::load(s), cos_x4 = doublex4::load(c);
+        q = vec3x4(cos_x4 * p.x() + sin_x4 * p.z(), p.y(), cos_x4 * p.z() - sin_x4 * p.x());
+        if (count == 1) return doublex4(INFINITY);
+
+        doublex4 hs(half_sin), hc(half_cos);
+        return vmin(vabs(hc * q.z() - hs * q.x()), vabs(hc * q.z() + hs * q.x()));
+    }
+
+    vec3 unfold(const vec3& p, const vec3& v) const override {
+        return rotate(v, copy_angle(p));
+    }
+
+private:
+    /**
+     * @return Angle of the copy whose wedge contains p
+     */
+    double copy_angle(const vec3& p) const {
+        return sector * std::round(std::atan2(p.z(), p.x()) / sector);
+    }
+
+    /**
+     * Rotates a vector around the y axis, from the x axis towards the z axis
+     */
+    static vec3 rotate(const vec3& v, double angle) {
+        double s = std::sin(angle), c = std::cos(angle);
+        return vec3(c * v.x() - s * v.z(), v.y(), s * v.x() + c * v.z());
+    }
+
+private:
+    int count;
+    double sector;
+    double half_sin, half_cos;
+
+    /**
+     * Sine and cosine of the angle of every copy
+     */
+    std::vector<double> copy_sin, copy_cos;
+};
+
+/**
+ * Places copies of a child object at an explicit list of positions. A k-d tree finds the closest and second closest
+ * position, so the cost per evaluation grows only logarithmically with the number of copies. The child is centered
+ * around its origin and must be bounded; copies may overlap
+ */
+class sdf_instances : public sdf_instancing {
+public:
+    /**
+     * @param _obj Child object
+     * @param positions Positions of the copies. Without any, the node has no surface
+     */
+    sdf_instances(sdf_object* _obj, std::vector<vec3> positions);
+
+    aabb bounds() const override { return box; }
+
+    /**
+     * @return Number of copies
+     */
+    size_t size() const { return points.size(); }
+
+protected:
+    double fold(const vec3& p, vec3& q) const override;
+
+private:
+    void build(size_t begin, size_t end);
+
+    /**
+     * Finds the closest and second closest of the positions in the subtree [begin, end) of the k-d tree
+     */
+    void nearest(const vec3& p, size_t begin, size_t end, size_t& best, double& best_d2, double& second_d2) const;
+
+private:
+    /**
+     * Positions in k-d tree order: the median of every range [begin, end) is its root, split along split_axes
+     */
+    std::vector<vec3> points;
+    std::vector<unsigned char> split_axes;
+
+    /**
+     * Distance from the child's origin to the farthest corner of its bounds
+     */
+    double radius = 0;
+    aabb box;
+};
+
+#endif //CPU_RAYMARCHER_INSTANCING_H
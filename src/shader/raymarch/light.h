@@ -1,6 +1,8 @@
 #ifndef RAYTRACING_IN_A_WEEKEND_LIGHT_H
 #define RAYTRACING_IN_A_WEEKEND_LIGHT_H
 
+#include <cmath>
+
 /**
  * Abstract light source class
  */
@@ -20,6 +22,19 @@ public:
      */
     virtual double intensity(const point3& p) const = 0;
 
+    /**
+     * Returns the distance from the given destination to the light source. Objects further away than this can't
+     * cast shadows onto the destination
+     * @param p Light destination
+     * @return Distance to the light source, infinite if the light has no position
+     */
+    virtual double light_distance(const point3& /*p*/) const { return INFINITY; }
+
+    /**
+     * @return Whether the light comes from the same direction at every destination
+     */
+    virtual bool directional() const { return false; }
+
     virtual ~light_source() {}
 };
 
@@ -38,6 +53,8 @@ public:
         return intnsty;
     }
 
+    bool directional() const override { return true; }
+
 private:
     vec3 dir;
     double intnsty;
@@ -62,6 +79,10 @@ public:
         return intnsty * 1 / falloff;
     }
 
+    double light_distance(const point3& p) const override {
+        return (p - pos).length();
+    }
+
 private:
     point3 pos;
     double intnsty;
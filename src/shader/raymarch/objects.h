@@ -2,9 +2,58 @@
 #define RAYTRACING_IN_A_WEEKEND_OBJECTS_H
 
 #include <vector>
+#include "sdf_profiler.h"
 #include "../../util/vec3.h"
+#include "../../util/vec3x4.h"
+#include "../../util/aabb.h"
 #include "../../util/math.h"
 #include "light.h"
+#include "ray.h"
+#include "sdf_program.h"
+
+class sdf_object;
+
+/**
+ * The leaf object of an object tree that determines the distance at a point, see sdf_object::sdf_leaf
+ */
+struct sdf_hit {
+    /**
+     * The leaf object. 'nullptr' if nothing was attributed
+     */
+    const sdf_object* leaf = nullptr;
+
+    /**
+     * The object whose diffuse color applies at the point. Usually the leaf itself, but nodes that carry a color of
+     * their own, like sdf_padded, claim the surfaces of their subtree
+     */
+    const sdf_object* material = nullptr;
+
+    /**
+     * The point in the leaf's parent space, i.e. the space its sdf() was evaluated in
+     */
+    point3 local;
+
+    /**
+     * -1 if the leaf's inside faces outwards, e.g. for the subtracted object of an sdf_diff, otherwise 1
+     */
+    double sign = 1;
+
+    /**
+     * Directions of the axes of the leaf's parent space in world space, used to map its normals to world space.
+     * Nodes that mirror, rotate or warp space, see instancing.h and warp.h, map them back into their own parent space
+     */
+    vec3 axes[3] = {vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1)};
+
+    /**
+     * @return Surface normal at the point in world space, see sdf_object::normal
+     */
+    inline vec3 normal() const;
+
+    /**
+     * @return Diffuse color of the material at the point
+     */
+    inline color diffuse_color() const;
+};
 
 /**
  * Abstract generic 'signed distance function'-object.
@@ -22,28 +71,102 @@ public:
      */
     virtual double sdf(const vec3& p) const = 0;
 
+    /**
+     * Calculates the signed distances from four points at once. Shapes override this with vectorized math; this
+     * default implementation evaluates sdf() for each lane
+     * @param p Points in world space
+     * @return Shortest distances from the points to the object's surface
+     */
+    virtual doublex4 sdf_x4(const vec3x4& p) const {
+        SDF_PROFILE_SCOPE(this);
+        return doublex4(sdf(p.lane(0)), sdf(p.lane(1)), sdf(p.lane(2)), sdf(p.lane(3)));
+    }
+
     /**
      * Calculates the normal unit vector of the object's surface for a given point. This point does
      * not necessarily have to be on the surface exactly.
-     * This default implementation approximates the normal as the gradient of the signed distance field. Specific,
-     * more performant or accurate implementations for specific shapes can be provided by overriding this function.
+     * This default implementation approximates the normal as the gradient of the signed distance field, sampled at
+     * the four corners of a tetrahedron. Specific, more performant or accurate implementations for specific shapes
+     * can be provided by overriding this function.
      * @param p Point in world space
      * @return Unit vector that points from the object's surface to p or into the normal direction of the
      * surface if p is on the object's surface
      */
     virtual vec3 normal(const vec3& p) const {
-        static vec3 DX(NORMAL_STEP, 0, 0);
-        static vec3 DY(0, NORMAL_STEP, 0);
-        static vec3 DZ(0, 0, NORMAL_STEP);
-        double x1 = sdf(p - DX);
-        double x2 = sdf(p + DX);
-        double y1 = sdf(p - DY);
-        double y2 = sdf(p + DY);
-        double z1 = sdf(p - DZ);
-        double z2 = sdf(p + DZ);
-        return unit_vector(vec3(x2 - x1, y2 - y1, z2 - z1));
+        return unit_vector(tetrahedral_gradient(p));
     }
 
+    /**
+     * Calculates the signed distance and its gradient at once. Composites pass on the gradient of the child that
+     * determines their distance, so shapes with an analytic gradient give an exact normal of a whole object tree
+     * in a single traversal. This default implementation estimates the gradient numerically
+     * @param p Point in world space
+     * @param grad Receives the gradient of the signed distance field at p
+     * @return Shortest distance from p to the object's surface
+     */
+    virtual double sdf_grad(const vec3& p, vec3& grad) const {
+        grad = tetrahedral_gradient(p);
+        return sdf(p);
+    }
+
+    /**
+     * Calculates the signed distance and attributes it to the leaf object that determines it. Normals and colors
+     * can then be taken from the leaf directly, without walking the object tree again. This default implementation
+     * attributes the distance to the object itself, composites override it
+     * @param p Point in world space
+     * @param hit Receives the leaf object and the point in its parent space
+     * @return Shortest distance from p to the object's surface
+     */
+    virtual double sdf_leaf(const vec3& p, sdf_hit& hit) const {
+        hit = sdf_hit {this, this, p};
+        return sdf(p);
+    }
+
+    /**
+     * Appends instructions that evaluate this object to a compiled sdf_program. This default implementation emits a
+     * CALL instruction that invokes sdf() through the virtual function. Node types with an opcode of their own
+     * override this
+     * @param prog Program being compiled
+     * @param offset Translation of all enclosing composites, the object is evaluated at p - offset
+     */
+    virtual void compile(sdf_program& prog, const vec3& offset) const {
+        prog.emit_leaf(sdf_opcode::CALL, offset, vec3(), 0, 0, this);
+    }
+
+    /**
+     * Returns a conservative axis aligned bounding box of the object's surface, so that the distance to the box
+     * never exceeds the distance to the object. This default implementation returns an infinite box, which is
+     * always correct
+     * @return Bounding box in the object's parent space
+     */
+    virtual aabb bounds() const { return aabb::infinite(); }
+
+    /**
+     * Returns the Lipschitz bound of the object's signed distance function: its value changes by at most this much
+     * per unit of distance, so sdf() / lipschitz() never exceeds the distance to the surface. Exact distance
+     * functions have a bound of 1; nodes that warp space report larger bounds, and composites pass on the largest
+     * bound of their children. Marchers divide every distance by it to get a safe step
+     * @return Lipschitz bound, at least 1
+     */
+    double lipschitz() const { return lipschitz_bound; }
+
+    /**
+     * Returns a bound of how fast the signed distance changes along a segment of a ray. It is never larger than
+     * lipschitz(), and lets segment tracing step further than the distance wherever the field is gentle along the
+     * ray. This default implementation returns the global bound
+     * @param r Ray in the object's parent space, with a unit direction
+     * @param t0 Start of the segment
+     * @param t1 End of the segment
+     * @return Largest rate of change of sdf() along the ray between r.at(t0) and r.at(t1)
+     */
+    virtual double segment_lipschitz(const ray& /*r*/, double /*t0*/, double /*t1*/) const { return lipschitz(); }
+
+    /**
+     * Tells the object that its child objects are owned elsewhere, e.g. by an arena, and must not be deleted along
+     * with it
+     */
+    virtual void disown_children() {}
+
     virtual vec3 get_pos() const { return position; }
     void set_pos(point3 p) { position = p; }
     virtual color get_diffuse_color(point3& p) const { return diffuse_color; }
@@ -51,6 +174,38 @@ public:
 
     virtual ~sdf_object() {}
 
+protected:
+    /**
+     * Estimates the gradient of the signed distance field from four samples at the corners of a tetrahedron around
+     * p, which costs a single sdf_x4 call
+     * @param p Point in world space
+     * @return Approximate gradient at p
+     */
+    vec3 tetrahedral_gradient(const vec3& p) const {
+        static const vec3 K0(1, -1, -1), K1(-1, -1, 1), K2(-1, 1, -1), K3(1, 1, 1);
+        double d[4];
+        sdf_x4(vec3x4(p + NORMAL_STEP * K0, p + NORMAL_STEP * K1, p + NORMAL_STEP * K2, p + NORMAL_STEP * K3)).store(d);
+        return (d[0] * K0 + d[1] * K1 + d[2] * K2 + d[3] * K3) / (4 * NORMAL_STEP);
+    }
+
+    /**
+     * segment_lipschitz() for convex shapes. Their signed distance is convex along any ray, so its slope only grows
+     * from the start to the end of a segment, and the gradients at both ends bound it
+     */
+    double convex_segment_lipschitz(const ray& r, double t0, double t1) const {
+        vec3 g0, g1;
+        sdf_grad(r.at(t0), g0);
+        sdf_grad(r.at(t1), g1);
+        double bound = max(abs(dot(g0, r.direction())), abs(dot(g1, r.direction())));
+        return bound <= lipschitz() ? bound : lipschitz();
+    }
+
+protected:
+    /**
+     * Lipschitz bound of sdf(), see lipschitz(). Set once by the constructor
+     */
+    double lipschitz_bound = 1;
+
 private:
     color diffuse_color;
     point3 position;
@@ -61,34 +216,85 @@ private:
 
 
 
+vec3 sdf_hit::normal() const {
+    vec3 n = leaf->normal(local);
+    return sign * unit_vector(n.x() * axes[0] + n.y() * axes[1] + n.z() * axes[2]);
+}
+
+color sdf_hit::diffuse_color() const {
+    point3 p = local;
+    return material->get_diffuse_color(p);
+}
+
 /************************
  *   SDF Object Types   *
  ************************/
 
 class sdf_padded : public sdf_object {
 public:
-    sdf_padded(sdf_object* _obj, double _padding) : obj(_obj), padding(_padding) {}
+    sdf_padded(sdf_object* _obj, double _padding) : obj(_obj), padding(_padding) {
+        lipschitz_bound = obj->lipschitz();
+    }
 
     double sdf(const vec3 &p) const override {
+        SDF_PROFILE_SCOPE(this);
         return obj->sdf(p) - padding;
     }
 
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return obj->sdf_x4(p) - doublex4(padding);
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        return obj->sdf_grad(p, grad) - padding;
+    }
+
+    double segment_lipschitz(const ray& r, double t0, double t1) const override {
+        return obj->segment_lipschitz(r, t0, t1);
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        double d = obj->sdf_leaf(p, hit) - padding;
+        hit.material = this;
+        return d;
+    }
+
+    vec3 normal(const vec3& p) const override {
+        vec3 grad;
+        sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        obj->compile(prog, offset);
+        prog.emit_pad(padding);
+    }
+
+    aabb bounds() const override {
+        return obj->bounds().expanded(max(padding, 0.0));
+    }
+
     vec3 get_pos() const override {
         return obj->get_pos();
     }
 
+    void disown_children() override { owns_children = false; }
+
     ~sdf_padded() {
-        delete obj;
+        if (owns_children) delete obj;
     }
 private:
     sdf_object* obj;
     double padding;
+    bool owns_children = true;
 };
 
 class sdf_composite : public sdf_object {
 public:
     sdf_composite(point3 _position, sdf_object* _o1, sdf_object* _o2) : o1(_o1), o2(_o2) {
         set_pos(_position);
+        lipschitz_bound = max(o1->lipschitz(), o2->lipschitz());
     }
 
     color get_diffuse_color(point3& p) const override {
@@ -96,13 +302,34 @@ public:
         else return o2->get_diffuse_color(p);
     }
 
+    /**
+     * The slope of the combined distance along a ray never exceeds the slopes of the children
+     */
+    double segment_lipschitz(const ray& r, double t0, double t1) const override {
+        ray local(r.origin() - get_pos(), r.direction());
+        return max(o1->segment_lipschitz(local, t0, t1), o2->segment_lipschitz(local, t0, t1));
+    }
+
+    /**
+     * Normal of the combined surface, taken from the gradient of the child that determines the distance at p
+     */
+    vec3 normal(const vec3& p) const override {
+        vec3 grad;
+        sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+    void disown_children() override { owns_children = false; }
+
     ~sdf_composite() {
+        if (!owns_children) return;
         delete o1;
         delete o2;
     }
 
 protected:
     sdf_object *o1, *o2;
+    bool owns_children = true;
 };
 
 class sdf_diff : public sdf_composite {
@@ -110,8 +337,47 @@ public:
     sdf_diff(const point3 &position, sdf_object *o1, sdf_object *o2) : sdf_composite(position, o1, o2) {}
 
     double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
         return max(o1->sdf(p-get_pos()), -(o2->sdf(p-get_pos())));
     }
+
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return vmax(o1->sdf_x4(p-get_pos()), -(o2->sdf_x4(p-get_pos())));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 grad2;
+        double d1 = o1->sdf_grad(p-get_pos(), grad);
+        double d2 = o2->sdf_grad(p-get_pos(), grad2);
+        if (d1 < -d2) {
+            grad = -grad2;
+            return -d2;
+        }
+        return d1;
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        sdf_hit hit2;
+        double d1 = o1->sdf_leaf(p-get_pos(), hit);
+        double d2 = o2->sdf_leaf(p-get_pos(), hit2);
+        if (d1 < -d2) {
+            hit = hit2;
+            hit.sign = -hit.sign;
+            return -d2;
+        }
+        return d1;
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        o1->compile(prog, offset + get_pos());
+        o2->compile(prog, offset + get_pos());
+        prog.emit_binary(sdf_opcode::DIFF);
+    }
+
+    aabb bounds() const override {
+        return o1->bounds().translated(get_pos());
+    }
 };
 
 class sdf_union : public sdf_composite {
@@ -119,8 +385,46 @@ public:
     sdf_union(const point3 &position, sdf_object *o1, sdf_object *o2) : sdf_composite(position, o1, o2) {}
 
     double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
         return min(o1->sdf(p-get_pos()), o2->sdf(p-get_pos()));
     }
+
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return vmin(o1->sdf_x4(p-get_pos()), o2->sdf_x4(p-get_pos()));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 grad2;
+        double d1 = o1->sdf_grad(p-get_pos(), grad);
+        double d2 = o2->sdf_grad(p-get_pos(), grad2);
+        if (d2 < d1) {
+            grad = grad2;
+            return d2;
+        }
+        return d1;
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        sdf_hit hit2;
+        double d1 = o1->sdf_leaf(p-get_pos(), hit);
+        double d2 = o2->sdf_leaf(p-get_pos(), hit2);
+        if (d2 < d1) {
+            hit = hit2;
+            return d2;
+        }
+        return d1;
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        o1->compile(prog, offset + get_pos());
+        o2->compile(prog, offset + get_pos());
+        prog.emit_binary(sdf_opcode::UNION);
+    }
+
+    aabb bounds() const override {
+        return aabb::merge(o1->bounds(), o2->bounds()).translated(get_pos());
+    }
 };
 
 class sdf_intersect : public sdf_composite {
@@ -128,8 +432,120 @@ public:
     sdf_intersect(const point3 &position, sdf_object *o1, sdf_object *o2) : sdf_composite(position, o1, o2) {}
 
     double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
         return max(o1->sdf(p-get_pos()), o2->sdf(p-get_pos()));
     }
+
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return vmax(o1->sdf_x4(p-get_pos()), o2->sdf_x4(p-get_pos()));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 grad2;
+        double d1 = o1->sdf_grad(p-get_pos(), grad);
+        double d2 = o2->sdf_grad(p-get_pos(), grad2);
+        if (d1 < d2) {
+            grad = grad2;
+            return d2;
+        }
+        return d1;
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        sdf_hit hit2;
+        double d1 = o1->sdf_leaf(p-get_pos(), hit);
+        double d2 = o2->sdf_leaf(p-get_pos(), hit2);
+        if (d1 < d2) {
+            hit = hit2;
+            return d2;
+        }
+        return d1;
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        o1->compile(prog, offset + get_pos());
+        o2->compile(prog, offset + get_pos());
+        prog.emit_binary(sdf_opcode::INTERSECT);
+    }
+
+    aabb bounds() const override {
+        return aabb::intersect(o1->bounds(), o2->bounds()).translated(get_pos());
+    }
+};
+
+/**
+ * Union of two objects with a smooth, rounded transition where they meet (polynomial smooth minimum). The blended
+ * distance is no longer exact, but it keeps the Lipschitz bound of the children
+ */
+class sdf_smooth_union : public sdf_composite {
+public:
+    /**
+     * @param position Translation of both children
+     * @param o1 First child object
+     * @param o2 Second child object
+     * @param _blend Distance below which the two surfaces get blended, > 0
+     */
+    sdf_smooth_union(const point3 &position, sdf_object *o1, sdf_object *o2, double _blend)
+        : sdf_composite(position, o1, o2), blend(_blend) {}
+
+    double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        double d1 = o1->sdf(p-get_pos()), d2 = o2->sdf(p-get_pos());
+        double h = max(blend - abs(d1 - d2), 0.0) / blend;
+        return min(d1, d2) - h * h * blend / 4;
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        doublex4 d1 = o1->sdf_x4(p-get_pos()), d2 = o2->sdf_x4(p-get_pos());
+        doublex4 k(blend);
+        doublex4 h = vmax(k - vabs(d1 - d2), doublex4(0.0)) / k;
+        return vmin(d1, d2) - h * h * k / doublex4(4.0);
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 grad2;
+        double d1 = o1->sdf_grad(p-get_pos(), grad);
+        double d2 = o2->sdf_grad(p-get_pos(), grad2);
+        double h = max(blend - abs(d1 - d2), 0.0) / blend;
+        // The smooth minimum weighs the gradient of the closer child with 1 - h/2 and the other one with h/2
+        if (d2 < d1) {
+            grad = (1 - h / 2) * grad2 + (h / 2) * grad;
+        } else {
+            grad = (1 - h / 2) * grad + (h / 2) * grad2;
+        }
+        return min(d1, d2) - h * h * blend / 4;
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        sdf_hit hit2;
+        double d1 = o1->sdf_leaf(p-get_pos(), hit);
+        double d2 = o2->sdf_leaf(p-get_pos(), hit2);
+        double h = max(blend - abs(d1 - d2), 0.0) / blend;
+        if (d2 < d1) hit = hit2;
+        if (h > 0) {
+            // Inside the blend the surface belongs to neither child, only the color is taken from the closer one
+            const sdf_object* material = hit.material;
+            hit = sdf_hit {this, material, p};
+        }
+        return min(d1, d2) - h * h * blend / 4;
+    }
+
+    vec3 normal(const vec3& p) const override {
+        vec3 grad;
+        sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+    aabb bounds() const override {
+        // The blend lowers the distance by at most blend / 4, which only gives a bound for exact children
+        if (lipschitz_bound > 1) return aabb::infinite();
+        return aabb::merge(o1->bounds(), o2->bounds()).expanded(blend / 4).translated(get_pos());
+    }
+
+private:
+    double blend;
 };
 
 class sdf_sphere : public sdf_object {
@@ -139,9 +555,34 @@ public:
     }
 
     double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
         return (p - get_pos()).length() - radius;
     }
 
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return (p - get_pos()).length() - doublex4(radius);
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 q = p - get_pos();
+        double l = q.length();
+        grad = q / l;
+        return l - radius;
+    }
+
+    double segment_lipschitz(const ray& r, double t0, double t1) const override {
+        return convex_segment_lipschitz(r, t0, t1);
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        prog.emit_leaf(sdf_opcode::SPHERE, get_pos() + offset, vec3(), radius, 0);
+    }
+
+    aabb bounds() const override {
+        return aabb::around(get_pos(), vec3(radius));
+    }
+
     vec3 normal(const vec3& p) const override {
         return unit_vector(p - get_pos());
     }
@@ -157,6 +598,7 @@ public:
     }
 
     double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
         vec3 q = p - get_pos();
 
         double dxz = max(0.0, sqrt(q.x() * q.x() + q.z() * q.z()) - radius);
@@ -165,6 +607,45 @@ public:
         return sqrt(dxz*dxz + dy*dy);
     }
 
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        vec3x4 q = p - get_pos();
+
+        doublex4 dxz = vmax(doublex4(0.0), vsqrt(q.x() * q.x() + q.z() * q.z()) - doublex4(radius));
+        doublex4 dy = vmax(doublex4(0.0), vabs(q.y()) - doublex4(height / 2));
+
+        return vsqrt(dxz*dxz + dy*dy);
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        vec3 q = p - get_pos();
+
+        double r = sqrt(q.x() * q.x() + q.z() * q.z());
+        double dxz = max(0.0, r - radius);
+        double dy = max(0.0, abs(q.y()) - height / 2);
+        double d = sqrt(dxz*dxz + dy*dy);
+
+        if (d > 0) {
+            double radial = r > 0 ? dxz / r : 0.0;
+            grad = vec3(radial * q.x(), q.y() < 0 ? -dy : dy, radial * q.z()) / d;
+        } else {
+            grad = normal(p);
+        }
+        return d;
+    }
+
+    double segment_lipschitz(const ray& r, double t0, double t1) const override {
+        return convex_segment_lipschitz(r, t0, t1);
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        prog.emit_leaf(sdf_opcode::CYLINDER, get_pos() + offset, vec3(), radius, height / 2);
+    }
+
+    aabb bounds() const override {
+        return aabb::around(get_pos(), vec3(radius, height / 2, radius));
+    }
+
     vec3 normal(const vec3& p) const override {
         if (p.y() > (get_pos().y() + height / 2)) return vec3(0, 1, 0);
         if (p.y() < (get_pos().y() - height / 2)) return vec3(0, -1, 0);
@@ -190,10 +671,37 @@ public:
     }
 
     double sdf(const vec3 &p) const override {
+        SDF_PROFILE_SCOPE(this);
         double lambda = clamp(dot(p - get_pos(), v), 0.0, length);
         return ((get_pos() + lambda * v) - p).length() - radius;
     }
 
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        doublex4 lambda = vclamp(dot(p - get_pos(), v), doublex4(0.0), doublex4(length));
+        return ((lambda * v + get_pos()) - p).length() - doublex4(radius);
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        double lambda = clamp(dot(p - get_pos(), v), 0.0, length);
+        vec3 q = p - (get_pos() + lambda * v);
+        double l = q.length();
+        grad = q / l;
+        return l - radius;
+    }
+
+    double segment_lipschitz(const ray& r, double t0, double t1) const override {
+        return convex_segment_lipschitz(r, t0, t1);
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        prog.emit_leaf(sdf_opcode::CAPSULE, get_pos() + offset, v, length, radius);
+    }
+
+    aabb bounds() const override {
+        return aabb::merge(aabb(get_pos(), get_pos()), aabb(p2, p2)).expanded(radius);
+    }
+
     vec3 normal(const vec3 &p) const override {
         double lambda = clamp(dot(p - get_pos(), v), 0.0, length);
         return unit_vector(p - (get_pos() + lambda * v));
@@ -213,9 +721,31 @@ public:
     }
 
     double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
         return (p.y() - get_pos().y());
     }
 
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return (p.y() - doublex4(get_pos().y()));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        grad = vec3(0, 1, 0);
+        return sdf(p);
+    }
+
+    /**
+     * The distance to the plane changes linearly along a ray, by the ray's vertical direction
+     */
+    double segment_lipschitz(const ray& r, double /*t0*/, double /*t1*/) const override {
+        return abs(r.direction().y());
+    }
+
+    void compile(sdf_program& prog, const vec3& offset) const override {
+        prog.emit_leaf(sdf_opcode::PLANE, vec3(), vec3(), get_pos().y() + offset.y(), 0);
+    }
+
     vec3 normal(const vec3& p) const override {
         return vec3(0, 1, 0);
     }
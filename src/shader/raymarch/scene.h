@@ -1,14 +1,22 @@
 #ifndef CPU_RAYMARCHER_SCENE_H
 #define CPU_RAYMARCHER_SCENE_H
 
+#include <memory>
+#include "../../util/arena.h"
 #include "objects.h"
 #include "light.h"
 
 /**
- * Container object for sdf objects and light sources
+ * Container object for sdf objects and light sources. Objects added with operator+= are owned by the scene and
+ * deleted along with it. Scenes made by a scene_builder instead keep their objects in the builder's arena and are
+ * shared, immutably, through a std::shared_ptr<const scene>
  */
 class scene {
 public:
+    scene() = default;
+    scene(const scene&) = delete;
+    scene& operator=(const scene&) = delete;
+
     scene& operator+=(sdf_object* obj) {
         objects.push_back(obj);
         return *this;
@@ -20,13 +28,27 @@ public:
     }
 
     ~scene() {
+        if (storage != nullptr) return;
         for(auto obj : objects) delete obj;
         for(auto lsrc : light_sources) delete lsrc;
     }
 public:
     std::vector<sdf_object*> objects;
     std::vector<light_source*> light_sources;
-    double ambient_light;
+    double ambient_light = 0;
+
+private:
+    friend class scene_builder;
+
+    /**
+     * Arena that owns the objects of a scene made by a scene_builder
+     */
+    std::unique_ptr<arena> storage;
+
+    /**
+     * Scenes whose objects are part of this scene, see scene_builder::include
+     */
+    std::vector<std::shared_ptr<const scene>> includes;
 };
 
 #endif //CPU_RAYMARCHER_SCENE_H
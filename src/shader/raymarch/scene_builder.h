@@ -0,0 +1,99 @@
+#ifndef CPU_RAYMARCHER_SCENE_BUILDER_H
+#define CPU_RAYMARCHER_SCENE_BUILDER_H
+
+#include "scene.h"
+
+/**
+ * Assembles a scene whose objects and light sources all live next to each other in a single arena, then freezes it
+ * into an immutable snapshot. The snapshot is reference-counted and can be shared by any number of shaders and
+ * threads; the arena is released along with the last reference
+ */
+class scene_builder {
+public:
+    /**
+     * @param _block_size Size in bytes of the arena's memory blocks. Scenes that fit into one block cost a single
+     * heap allocation for all of their objects
+     */
+    explicit scene_builder(size_t _block_size = 64 * 1024)
+        : block_size(_block_size), storage(new arena(_block_size)) {}
+
+    /**
+     * Constructs an object or light source inside of the scene's arena. Child objects passed to composites must
+     * have been made by the same builder
+     * @tparam T Type of the object
+     * @param args Constructor arguments
+     * @return Pointer to the object. Must not be deleted
+     */
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* node = storage->make<T>(std::forward<Args>(args)...);
+        disown(node);
+        return node;
+    }
+
+    scene_builder& operator+=(sdf_object* obj) {
+        objects.push_back(obj);
+        return *this;
+    }
+
+    scene_builder& operator+=(light_source* obj) {
+        light_sources.push_back(obj);
+        return *this;
+    }
+
+    /**
+     * Adds all objects and light sources of another scene and takes over its ambient light. The other scene is
+     * kept alive by the new one
+     * @param other Frozen scene to be included
+     */
+    scene_builder& include(const std::shared_ptr<const scene>& other) {
+        objects.insert(objects.end(), other->objects.begin(), other->objects.end());
+        light_sources.insert(light_sources.end(), other->light_sources.begin(), other->light_sources.end());
+        ambient_light = other->ambient_light;
+        includes.push_back(other);
+        return *this;
+    }
+
+    /**
+     * Turns everything added so far into an immutable scene. The builder starts over with an empty scene afterwards
+     * @return The frozen scene
+     */
+    std::shared_ptr<const scene> freeze() {
+        auto frozen = std::make_shared<scene>();
+        frozen->objects = std::move(objects);
+        frozen->light_sources = std::move(light_sources);
+        frozen->ambient_light = ambient_light;
+        frozen->storage = std::move(storage);
+        frozen->includes = std::move(includes);
+
+        objects.clear();
+        light_sources.clear();
+        includes.clear();
+        storage.reset(new arena(block_size));
+        return frozen;
+    }
+
+    /**
+     * @return Number of bytes the objects made so far occupy in the arena
+     */
+    size_t memory_usage() const { return storage->used(); }
+
+public:
+    double ambient_light = 0;
+
+private:
+    /**
+     * Children of arena objects are destroyed by the arena, not by their parents
+     */
+    static void disown(sdf_object* node) { node->disown_children(); }
+    static void disown(const void*) {}
+
+private:
+    size_t block_size;
+    std::unique_ptr<arena> storage;
+    std::vector<sdf_object*> objects;
+    std::vector<light_source*> light_sources;
+    std::vector<std::shared_ptr<const scene>> includes;
+};
+
+#endif //CPU_RAYMARCHER_SCENE_BUILDER_H
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <unordered_map>
+#include <cxxabi.h>
+#include "sdf_profiler.h"
+#include "objects.h"
+
+std::atomic<bool> sdf_profiler::enabled {false};
+
+/**
+ * Node being evaluated on a thread
+ */
+struct profiler_frame {
+    const sdf_object* node;
+    std::uint64_t begin;
+
+    /**
+     * Ticks spent in the evaluations of its children so far
+     */
+    std::uint64_t children;
+};
+
+/**
+ * Records of one thread. Only written by that thread, and only read by others between frames
+ */
+struct profiler_thread {
+    std::unordered_map<const sdf_object*, sdf_node_profile> nodes;
+    std::vector<profiler_frame> stack;
+};
+
+static std::mutex registry_lock;
+static std::vector<std::shared_ptr<profiler_thread>> registry;
+
+/**
+ * @return Records of the calling thread, registered on first use. They outlive the thread, so short-lived threads
+ * still show up in the report
+ */
+static profiler_thread& local_thread() {
+    thread_local std::shared_ptr<profiler_thread> data = []() {
+        auto created = std::make_shared<profiler_thread>();
+        std::lock_guard<std::mutex> guard(registry_lock);
+        registry.push_back(created);
+        return created;
+    }();
+    return *data;
+}
+
+bool sdf_profiler::enter(const sdf_object* node) {
+    profiler_thread& t = local_thread();
+    if (!t.stack.empty() && t.stack.back().node == node) return false;
+    t.stack.push_back(profiler_frame {node, 0, 0});
+    t.stack.back().begin = ticks();
+    return true;
+}
+
+void sdf_profiler::leave(std::uint64_t end) {
+    profiler_thread& t = local_thread();
+    profiler_frame f = t.stack.back();
+    t.stack.pop_back();
+    std::uint64_t elapsed = end - f.begin;
+
+    sdf_node_profile& profile = t.nodes[f.node];
+    profile.node = f.node;
+    profile.evals++;
+    profile.inclusive += elapsed;
+    profile.self += elapsed - min(f.children, elapsed);
+    if (!t.stack.empty()) {
+        if (profile.parent == nullptr) profile.parent = t.stack.back().node;
+        t.stack.back().children += elapsed;
+    }
+}
+
+void sdf_profiler::reset() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    for (auto& t : registry) t->nodes.clear();
+}
+
+std::vector<sdf_node_profile> sdf_profiler::collect() {
+    std::unordered_map<const sdf_object*, sdf_node_profile> merged;
+    {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        for (auto& t : registry) {
+            for (const auto& entry : t->nodes) {
+                sdf_node_profile& m = merged[entry.first];
+                const sdf_node_profile& p = entry.second;
+                m.node = p.node;
+                if (m.parent == nullptr) m.parent = p.parent;
+                m.evals += p.evals;
+                m.inclusive += p.inclusive;
+                m.self += p.self;
+            }
+        }
+    }
+
+    std::vector<sdf_node_profile> profiles;
+    for (const auto& entry : merged) profiles.push_back(entry.second);
+    std::sort(profiles.begin(), profiles.end(), [](const sdf_node_profile& a, const sdf_node_profile& b) {
+        return a.self != b.self ? a.self > b.self : a.inclusive > b.inclusive;
+    });
+    return profiles;
+}
+
+/**
+ * @return Readable name of the dynamic type of a node
+ */
+static std::string type_name(const sdf_object* node) {
+    const char* mangled = typeid(*node).name();
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    std::string name = status == 0 && demangled != nullptr ? demangled : mangled;
+    std::free(demangled);
+    return name;
+}
+
+void sdf_profiler::print_report(std::ostream& out, size_t max_rows) {
+    std::vector<sdf_node_profile> profiles = collect();
+    if (profiles.empty()) {
+        out << "SDF profile: no evaluations recorded" << std::endl;
+        return;
+    }
+
+    // Top-level objects contain all other nodes, so their inclusive time is the total
+    std::uint64_t total = 0;
+    std::unordered_map<const sdf_object*, size_t> ranks;
+    for (size_t i = 0; i < profiles.size(); i++) {
+        if (profiles[i].parent == nullptr) total += profiles[i].inclusive;
+        ranks[profiles[i].node] = i + 1;
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "SDF profile: %zu nodes, %.1f Mticks in distance evaluations\n",
+                  profiles.size(), total / 1e6);
+    out << line;
+    std::snprintf(line, sizeof(line), "%4s  %-28s %6s %12s %12s %12s %7s %10s\n", "rank", "node", "parent", "evals",
+                  "incl Mticks", "self Mticks", "self %", "ticks/eval");
+    out << line;
+
+    for (size_t i = 0; i < profiles.size() && i < max_rows; i++) {
+        const sdf_node_profile& p = profiles[i];
+        std::string parent = p.parent == nullptr ? "-" : "#" + std::to_string(ranks[p.parent]);
+        std::snprintf(line, sizeof(line), "#%-3zu  %-28.28s %6s %12ld %12.2f %12.2f %6.1f%% %10.1f\n", i + 1,
+                      type_name(p.node).c_str(), parent.c_str(), p.evals, p.inclusive / 1e6, p.self / 1e6,
+                      total > 0 ? 100.0 * p.self / total : 0.0, static_cast<double>(p.inclusive) / p.evals);
+        out << line;
+    }
+    if (profiles.size() > max_rows) out << "(" << profiles.size() - max_rows << " more nodes)" << std::endl;
+}
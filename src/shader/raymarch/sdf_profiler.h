@@ -0,0 +1,159 @@
+#ifndef CPU_RAYMARCHER_SDF_PROFILER_H
+#define CPU_RAYMARCHER_SDF_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+class sdf_object;
+
+/**
+ * Evaluation count and time spent in one node of an object tree
+ */
+struct sdf_node_profile {
+    const sdf_object* node = nullptr;
+
+    /**
+     * Node the evaluations were made from, nullptr for top-level objects of the scene
+     */
+    const sdf_object* parent = nullptr;
+
+    long evals = 0;
+
+    /**
+     * Ticks spent in the node's evaluations, including its children
+     */
+    std::uint64_t inclusive = 0;
+
+    /**
+     * Ticks spent in the node's evaluations, excluding its children
+     */
+    std::uint64_t self = 0;
+};
+
+/**
+ * Opt-in profiler that attributes distance evaluations and their time to the nodes of the object trees, nested nodes
+ * of composites included. It is compiled in with the CPU_RAYMARCHER_SDF_PROFILER option and then enabled at runtime
+ * with set_enabled(); without the option the instrumentation of sdf() and sdf_x4() compiles to nothing.
+ *
+ * Every thread records into its own table without any synchronization. The tables are merged by collect() once the
+ * frame is done, so no thread may evaluate distances while that happens. Time is measured in time stamp counter
+ * ticks where available. The measurement itself adds a few dozen ticks per evaluation, which shows up as self time of
+ * the parent nodes
+ */
+class sdf_profiler {
+public:
+    /**
+     * @return Whether the profiler was compiled in
+     */
+    static constexpr bool available() {
+#ifdef CPU_RAYMARCHER_SDF_PROFILER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @return Whether evaluations are currently recorded. The ray marcher evaluates the object trees directly instead
+     * of the compiled sdf_program while this is the case, so every node is seen
+     */
+    static bool active() {
+#ifdef CPU_RAYMARCHER_SDF_PROFILER
+        return enabled.load(std::memory_order_relaxed);
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Starts or stops recording. Has no effect unless the profiler was compiled in
+     */
+    static void set_enabled(bool on) { enabled.store(on && available(), std::memory_order_relaxed); }
+
+    /**
+     * Discards everything recorded so far, on all threads
+     */
+    static void reset();
+
+    /**
+     * Merges the records of all threads
+     * @return One profile per node, in descending order of self time
+     */
+    static std::vector<sdf_node_profile> collect();
+
+    /**
+     * Writes the merged records as a table ranked by self time. The nodes must still be alive
+     * @param out Output stream
+     * @param max_rows Maximum number of nodes listed
+     */
+    static void print_report(std::ostream& out, size_t max_rows = 25);
+
+    /**
+     * @return Current time in ticks
+     */
+    static std::uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * Records the evaluation of a node for as long as it is alive, see SDF_PROFILE_SCOPE
+     */
+    class scope {
+    public:
+        explicit scope(const sdf_object* node) {
+            if (active()) recording = enter(node);
+        }
+
+        ~scope() {
+            if (recording) leave(ticks());
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        bool recording = false;
+    };
+
+private:
+    /**
+     * Pushes a node onto the calling thread's stack of nodes being evaluated
+     * @return Whether the evaluation is recorded. Re-entering the node that is being evaluated, as the default
+     * sdf_x4() does through sdf(), isn't recorded a second time
+     */
+    static bool enter(const sdf_object* node);
+
+    /**
+     * Pops the innermost node off the calling thread's stack and records its evaluation
+     * @param end Time the evaluation ended at
+     */
+    static void leave(std::uint64_t end);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * Records the evaluation of a node by the enclosing function with the sdf_profiler, if it was compiled in
+ */
+#ifdef CPU_RAYMARCHER_SDF_PROFILER
+#define SDF_PROFILE_SCOPE(node) sdf_profiler::scope sdf_profile_scope_guard(node)
+#else
+#define SDF_PROFILE_SCOPE(node) ((void) 0)
+#endif
+
+#endif //CPU_RAYMARCHER_SDF_PROFILER_H
@@ -0,0 +1,103 @@
+#include "sdf_program.h"
+#include "objects.h"
+
+sdf_program sdf_program::compile(const std::vector<sdf_object*>& objects) {
+    sdf_program prog;
+    for (auto obj : objects) {
+        obj->compile(prog, vec3());
+        prog.depth--;
+        sdf_instruction store {sdf_opcode::STORE, 0, 0, static_cast<std::uint16_t>(prog.slots), 0, 0,
+                               vec3(), vec3(), nullptr};
+        prog.code.push_back(store);
+        prog.slots++;
+    }
+    return prog;
+}
+
+void sdf_program::eval(const vec3& p, double* out) const {
+    double reg[MAX_REGISTERS];
+    for (const sdf_instruction& in : code) {
+        switch (in.op) {
+            case sdf_opcode::SPHERE:
+                reg[in.dst] = (p - in.v0).length() - in.s0;
+                break;
+            case sdf_opcode::CYLINDER: {
+                vec3 q = p - in.v0;
+                double dxz = max(0.0, sqrt(q.x() * q.x() + q.z() * q.z()) - in.s0);
+                double dy = max(0.0, abs(q.y()) - in.s1);
+                reg[in.dst] = sqrt(dxz*dxz + dy*dy);
+                break;
+            }
+            case sdf_opcode::CAPSULE: {
+                double lambda = clamp(dot(p - in.v0, in.v1), 0.0, in.s0);
+                reg[in.dst] = ((in.v0 + lambda * in.v1) - p).length() - in.s1;
+                break;
+            }
+            case sdf_opcode::PLANE:
+                reg[in.dst] = p.y() - in.s0;
+                break;
+            case sdf_opcode::CALL:
+                reg[in.dst] = in.node->sdf(p - in.v0);
+                break;
+            case sdf_opcode::UNION:
+                reg[in.dst] = min(reg[in.dst], reg[in.src]);
+                break;
+            case sdf_opcode::DIFF:
+                reg[in.dst] = max(reg[in.dst], -reg[in.src]);
+                break;
+            case sdf_opcode::INTERSECT:
+                reg[in.dst] = max(reg[in.dst], reg[in.src]);
+                break;
+            case sdf_opcode::PAD:
+                reg[in.dst] -= in.s0;
+                break;
+            case sdf_opcode::STORE:
+                out[in.slot] = reg[in.dst];
+                break;
+        }
+    }
+}
+
+void sdf_program::eval_x4(const vec3x4& p, doublex4* out) const {
+    doublex4 reg[MAX_REGISTERS];
+    for (const sdf_instruction& in : code) {
+        switch (in.op) {
+            case sdf_opcode::SPHERE:
+                reg[in.dst] = (p - in.v0).length() - doublex4(in.s0);
+                break;
+            case sdf_opcode::CYLINDER: {
+                vec3x4 q = p - in.v0;
+                doublex4 dxz = vmax(doublex4(0.0), vsqrt(q.x() * q.x() + q.z() * q.z()) - doublex4(in.s0));
+                doublex4 dy = vmax(doublex4(0.0), vabs(q.y()) - doublex4(in.s1));
+                reg[in.dst] = vsqrt(dxz*dxz + dy*dy);
+                break;
+            }
+            case sdf_opcode::CAPSULE: {
+                doublex4 lambda = vclamp(dot(p - in.v0, in.v1), doublex4(0.0), doublex4(in.s0));
+                reg[in.dst] = ((lambda * in.v1 + in.v0) - p).length() - doublex4(in.s1);
+                break;
+            }
+            case sdf_opcode::PLANE:
+                reg[in.dst] = p.y() - doublex4(in.s0);
+                break;
+            case sdf_opcode::CALL:
+                reg[in.dst] = in.node->sdf_x4(p - in.v0);
+                break;
+            case sdf_opcode::UNION:
+                reg[in.dst] = vmin(reg[in.dst], reg[in.src]);
+                break;
+            case sdf_opcode::DIFF:
+                reg[in.dst] = vmax(reg[in.dst], -reg[in.src]);
+                break;
+            case sdf_opcode::INTERSECT:
+                reg[in.dst] = vmax(reg[in.dst], reg[in.src]);
+                break;
+            case sdf_opcode::PAD:
+                reg[in.dst] = reg[in.dst] - doublex4(in.s0);
+                break;
+            case sdf_opcode::STORE:
+                out[in.slot] = reg[in.dst];
+                break;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef CPU_RAYMARCHER_SDF_PROGRAM_H
+#define CPU_RAYMARCHER_SDF_PROGRAM_H
+
+#include <cstdint>
+#include <vector>
+#include "../../util/vec3x4.h"
+
+class sdf_object;
+
+/**
+ * Operations of a compiled sdf_program
+ */
+enum class sdf_opcode : std::uint8_t {
+    SPHERE,     // reg[dst] = |p - v0| - s0
+    CYLINDER,   // reg[dst] = capped cylinder around v0, s0 = radius, s1 = half height
+    CAPSULE,    // reg[dst] = capsule from v0 along unit direction v1, s0 = length, s1 = radius
+    PLANE,      // reg[dst] = p.y - s0
+    CALL,       // reg[dst] = node->sdf(p - v0), fallback for node types without an opcode
+    UNION,      // reg[dst] = min(reg[dst], reg[src])
+    DIFF,       // reg[dst] = max(reg[dst], -reg[src])
+    INTERSECT,  // reg[dst] = max(reg[dst], reg[src])
+    PAD,        // reg[dst] = reg[dst] - s0
+    STORE       // out[slot] = reg[dst]
+};
+
+/**
+ * Single instruction of an sdf_program. All translations of the enclosing composites are already folded into the
+ * vector operands
+ */
+struct sdf_instruction {
+    sdf_opcode op;
+    std::uint8_t dst;
+    std::uint8_t src;
+    std::uint16_t slot;
+    double s0, s1;
+    vec3 v0, v1;
+    const sdf_object* node;
+};
+
+/**
+ * A tree of sdf_objects lowered into a flat instruction stream. Leaves write their distance into a register of a
+ * small register file, composite nodes combine two registers, and a STORE per top-level object writes its distance
+ * to an output slot. Evaluation is a single loop over contiguous memory without virtual calls (except for CALL
+ * instructions of node types that have no opcode of their own)
+ */
+class sdf_program {
+public:
+    static constexpr int MAX_REGISTERS = 32;
+
+    /**
+     * Compiles a list of top-level objects. The distance to objects[i] is written to output slot i
+     * @param objects Top-level objects, usually scene::objects
+     * @return Compiled program
+     */
+    static sdf_program compile(const std::vector<sdf_object*>& objects);
+
+    /**
+     * Evaluates the distances of all top-level objects for a point
+     * @param p Point in world space
+     * @param out Receives one distance per top-level object
+     */
+    void eval(const vec3& p, double* out) const;
+
+    /**
+     * Evaluates the distances of all top-level objects for four points at once
+     * @param p Points in world space
+     * @param out Receives one distance pack per top-level object
+     */
+    void eval_x4(const vec3x4& p, doublex4* out) const;
+
+    /**
+     * @return Whether the program can be evaluated. Trees that need more than MAX_REGISTERS registers can't
+     */
+    bool valid() const { return !overflow && !code.empty(); }
+
+    /**
+     * @return Number of output slots
+     */
+    int slot_count() const { return slots; }
+
+    /**
+     * Emits a leaf instruction into the next free register. Used by sdf_object::compile
+     */
+    void emit_leaf(sdf_opcode op, const vec3& v0, const vec3& v1, double s0, double s1,
+                   const sdf_object* node = nullptr) {
+        sdf_instruction instr {op, static_cast<std::uint8_t>(depth), 0, 0, s0, s1, v0, v1, node};
+        code.push_back(instr);
+        push();
+    }
+
+    /**
+     * Emits an instruction combining the two most recently written registers into one
+     */
+    void emit_binary(sdf_opcode op) {
+        depth--;
+        sdf_instruction instr {op, static_cast<std::uint8_t>(depth - 1), static_cast<std::uint8_t>(depth), 0, 0, 0,
+                               vec3(), vec3(), nullptr};
+        code.push_back(instr);
+    }
+
+    /**
+     * Emits an instruction subtracting a padding from the most recently written register
+     */
+    void emit_pad(double padding) {
+        sdf_instruction instr {sdf_opcode::PAD, static_cast<std::uint8_t>(depth - 1), 0, 0, padding, 0,
+                               vec3(), vec3(), nullptr};
+        code.push_back(instr);
+    }
+
+private:
+    void push() {
+        depth++;
+        if (depth > MAX_REGISTERS) {
+            overflow = true;
+            depth = MAX_REGISTERS;
+        }
+    }
+
+private:
+    std::vector<sdf_instruction> code;
+    int depth = 0;
+    int slots = 0;
+    bool overflow = false;
+};
+
+#endif //CPU_RAYMARCHER_SDF_PROGRAM_H
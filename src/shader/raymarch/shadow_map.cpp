@@ -0,0 +1,72 @@
+#include "../../util/parallel.h"
+#include "shadow_map.h"
+#include "../../util/math.h"
+
+shadow_map::shadow_map(const vec3& light_dir, const settings& s, const std::function<double(const ray&)>& depth,
+                       double _reach) : texel_size(s.texel_size), reach(_reach) {
+    if (!s.region.bounded() || s.region.empty() || texel_size <= 0) return;
+
+    // Light space: u and v span the grid, w points towards the light
+    w = -unit_vector(light_dir);
+    u = unit_vector(cross(w, abs(w.y()) < 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0)));
+    v = cross(w, u);
+
+    double u_max = -INFINITY, v_max = -INFINITY, w_max = -INFINITY;
+    u_min = v_min = INFINITY;
+    for (int corner = 0; corner < 8; corner++) {
+        point3 c((corner & 1) ? s.region.max_corner().x() : s.region.min_corner().x(),
+                 (corner & 2) ? s.region.max_corner().y() : s.region.min_corner().y(),
+                 (corner & 4) ? s.region.max_corner().z() : s.region.min_corner().z());
+        u_min = min(u_min, dot(c, u));
+        u_max = max(u_max, dot(c, u));
+        v_min = min(v_min, dot(c, v));
+        v_max = max(v_max, dot(c, v));
+        w_max = max(w_max, dot(c, w));
+    }
+
+    // Rays start slightly outside of the region so that surfaces on its boundary are hit
+    w_origin = w_max + texel_size;
+    nu = static_cast<int>(std::ceil((u_max - u_min) / texel_size)) + 1;
+    nv = static_cast<int>(std::ceil((v_max - v_min) / texel_size)) + 1;
+    tolerance = 0.25 * texel_size;
+
+    depths.resize(static_cast<size_t>(nu) * nv);
+    parallel_for(nv, s.threads, [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; j++) {
+            for (int i = 0; i < nu; i++) {
+                point3 origin = (u_min + i * texel_size) * u + (v_min + j * texel_size) * v + w_origin * w;
+                depths[static_cast<size_t>(j) * nu + i] = static_cast<float>(depth(ray(origin, -w)));
+            }
+        }
+    });
+}
+
+double shadow_map::visibility(const point3& p) const {
+    double fu = (dot(p, u) - u_min) / texel_size;
+    double fv = (dot(p, v) - v_min) / texel_size;
+    double dp = w_origin - dot(p, w);
+    if (!(fu >= 0 && fv >= 0 && fu < nu - 1 && fv < nv - 1) || dp < 0 || dp > reach - tolerance) return -1;
+
+    int i = static_cast<int>(fu);
+    int j = static_cast<int>(fv);
+    double d00 = depth_at(i, j), d10 = depth_at(i + 1, j), d01 = depth_at(i, j + 1), d11 = depth_at(i + 1, j + 1);
+
+    if (std::isnan(d00) || std::isnan(d10) || std::isnan(d01) || std::isnan(d11)) return -1;
+    int misses = std::isinf(d00) + std::isinf(d10) + std::isinf(d01) + std::isinf(d11);
+    if (misses == 4) return 1;
+    if (misses > 0) return -1;
+
+    // On the first surface along its ray, a point's depth matches the interpolated depth of the surrounding rays
+    double interpolated = lerp(lerp(d00, d10, fu - i), lerp(d01, d11, fu - i), fv - j);
+    if (abs(dp - interpolated) <= tolerance) return 1;
+
+    // A point is only known to be occluded if it lies behind a whole ring of rays around it, so that the edge of
+    // the occluder is at least a texel away. Anything else lies at a depth discontinuity
+    if (i < 1 || j < 1 || i + 2 >= nu || j + 2 >= nv) return -1;
+    for (int jj = j - 1; jj <= j + 2; jj++) {
+        for (int ii = i - 1; ii <= i + 2; ii++) {
+            if (!(dp > depth_at(ii, jj) + tolerance)) return -1;
+        }
+    }
+    return 0;
+}
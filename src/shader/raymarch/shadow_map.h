@@ -0,0 +1,87 @@
+#ifndef CPU_RAYMARCHER_SHADOW_MAP_H
+#define CPU_RAYMARCHER_SHADOW_MAP_H
+
+#include <functional>
+#include <vector>
+#include "../../util/aabb.h"
+#include "ray.h"
+
+/**
+ * Precomputed shadows of a directional light over a static scene. A grid of parallel rays is marched from the
+ * light's direction over a region of the scene, and the depth of the first surface along every ray is stored.
+ * Lookups compare a point's depth against the interpolated depth of the four surrounding rays and report when the
+ * grid can't tell whether the point is lit, e.g. close to the edge of a shadow
+ */
+class shadow_map {
+public:
+    /**
+     * Bake parameters
+     */
+    struct settings {
+        /**
+         * Region of space to be covered. Objects outside of it must not cast shadows into it
+         */
+        aabb region;
+
+        /**
+         * Distance between neighbouring rays of the grid. Occluders thinner than this may be missed
+         */
+        double texel_size = 0.05;
+
+        /**
+         * Number of bake threads. Values below 1 select std::thread::hardware_concurrency()
+         */
+        int threads = 0;
+    };
+
+    shadow_map() = default;
+
+    /**
+     * Bakes the shadow map of a directional light
+     * @param light_dir Direction in which the light travels
+     * @param s Bake parameters
+     * @param depth Function (const ray&) -> double that returns the travel distance to the first surface along a
+     * ray, infinity if the ray doesn't hit anything within 'reach', or NaN if that is unknown, e.g. because the ray
+     * gave up early. Points around unknown rays are reported as undecided by visibility
+     * @param reach Maximum travel distance of the rays passed to 'depth'
+     */
+    shadow_map(const vec3& light_dir, const settings& s, const std::function<double(const ray&)>& depth,
+               double reach);
+
+    /**
+     * @return Whether nothing has been baked
+     */
+    bool empty() const { return depths.empty(); }
+
+    /**
+     * Looks up whether the light reaches a point
+     * @param p Point in world space, usually slightly offset from a surface
+     * @return 1 if p is lit, 0 if p is in shadow, or a negative value if the map can't tell and a shadow ray has to
+     * be cast instead
+     */
+    double visibility(const point3& p) const;
+
+    /**
+     * @return Number of bytes occupied by the baked depths
+     */
+    size_t memory_usage() const { return depths.size() * sizeof(float); }
+
+private:
+    float depth_at(int i, int j) const { return depths[static_cast<size_t>(j) * nu + i]; }
+
+private:
+    vec3 u, v, w;
+    double u_min = 0, v_min = 0, w_origin = 0;
+    double texel_size = 0;
+    double reach = 0;
+    int nu = 0, nv = 0;
+
+    /**
+     * Tolerance of the depth comparison: points this close to the first surface of their ray count as lit
+     */
+    double tolerance = 0;
+
+    std::vector<float> depths;
+};
+
+#endif //CPU_RAYMARCHER_SHADOW_MAP_H
@@ -0,0 +1,357 @@
+#ifndef CPU_RAYMARCHER_STATIC_OBJECTS_H
+#define CPU_RAYMARCHER_STATIC_OBJECTS_H
+
+#include "objects.h"
+
+/**
+ * Compile-time composed counterparts of the sdf_object types. Shapes are plain value types combined through
+ * templates, e.g. static_union<static_padded<static_diff<static_sphere, static_sphere>>, static_capsule>, so the
+ * compiler sees the complete distance function of a scene and can inline and constant-fold it. A finished shape is
+ * put into a scene through sdf_static_object
+ */
+
+/**
+ * CRTP base of all static shapes. Provides the generic parts of the sdf_object interface in terms of the derived
+ * shape's sdf(); derived shapes hide these with more specific versions where available
+ * @tparam derived Shape type deriving from this class
+ */
+template<typename derived>
+class static_sdf {
+public:
+    /**
+     * Evaluates the derived shape's sdf() for each lane
+     */
+    doublex4 sdf_x4(const vec3x4& p) const {
+        return doublex4(self().sdf(p.lane(0)), self().sdf(p.lane(1)), self().sdf(p.lane(2)), self().sdf(p.lane(3)));
+    }
+
+    /**
+     * Approximates the normal as the gradient of the signed distance field, see sdf_object::normal
+     */
+    vec3 normal(const vec3& p) const { return unit_vector(tetrahedral_gradient(p)); }
+
+    /**
+     * Returns the derived shape's sdf() along with a numerical estimate of its gradient, see sdf_object::sdf_grad
+     */
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        grad = tetrahedral_gradient(p);
+        return self().sdf(p);
+    }
+
+protected:
+    const derived& self() const { return static_cast<const derived&>(*this); }
+
+    /**
+     * Tetrahedral gradient estimate, see sdf_object::tetrahedral_gradient
+     */
+    vec3 tetrahedral_gradient(const vec3& p) const {
+        const vec3 K0(1, -1, -1), K1(-1, -1, 1), K2(-1, 1, -1), K3(1, 1, 1);
+        double d[4];
+        self().sdf_x4(vec3x4(p + NORMAL_STEP * K0, p + NORMAL_STEP * K1,
+                             p + NORMAL_STEP * K2, p + NORMAL_STEP * K3)).store(d);
+        return (d[0] * K0 + d[1] * K1 + d[2] * K2 + d[3] * K3) / (4 * NORMAL_STEP);
+    }
+
+    static constexpr double NORMAL_STEP = 0.0008;
+};
+
+/**
+ * Base of static leaf shapes: a position and a diffuse color
+ */
+template<typename derived>
+class static_leaf : public static_sdf<derived> {
+public:
+    static_leaf(const point3& _pos, const color& _diffuse_color) : pos(_pos), diffuse(_diffuse_color) {}
+
+    color diffuse_color(const vec3& /*p*/) const { return diffuse; }
+
+protected:
+    point3 pos;
+    color diffuse;
+};
+
+/************************
+ *   Static Leaf Shapes *
+ ************************/
+
+class static_sphere : public static_leaf<static_sphere> {
+public:
+    static_sphere(const point3& _pos, double _radius, const color& _diffuse_color = color(1))
+        : static_leaf(_pos, _diffuse_color), radius(_radius) {}
+
+    double sdf(const vec3& p) const { return (p - pos).length() - radius; }
+    doublex4 sdf_x4(const vec3x4& p) const { return (p - pos).length() - doublex4(radius); }
+    vec3 normal(const vec3& p) const { return unit_vector(p - pos); }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        vec3 q = p - pos;
+        double l = q.length();
+        grad = q / l;
+        return l - radius;
+    }
+
+private:
+    double radius;
+};
+
+class static_cylinder : public static_leaf<static_cylinder> {
+public:
+    static_cylinder(const point3& _pos, double _height, double _radius, const color& _diffuse_color = color(1))
+        : static_leaf(_pos, _diffuse_color), height(_height), radius(_radius) {}
+
+    double sdf(const vec3& p) const {
+        vec3 q = p - pos;
+        double dxz = max(0.0, sqrt(q.x() * q.x() + q.z() * q.z()) - radius);
+        double dy = max(0.0, abs(q.y()) - height / 2);
+        return sqrt(dxz*dxz + dy*dy);
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const {
+        vec3x4 q = p - pos;
+        doublex4 dxz = vmax(doublex4(0.0), vsqrt(q.x() * q.x() + q.z() * q.z()) - doublex4(radius));
+        doublex4 dy = vmax(doublex4(0.0), vabs(q.y()) - doublex4(height / 2));
+        return vsqrt(dxz*dxz + dy*dy);
+    }
+
+    vec3 normal(const vec3& p) const {
+        if (p.y() > (pos.y() + height / 2)) return vec3(0, 1, 0);
+        if (p.y() < (pos.y() - height / 2)) return vec3(0, -1, 0);
+        return unit_vector(vec3(p.x() - pos.x(), 0, p.z() - pos.z()));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        vec3 q = p - pos;
+        double r = sqrt(q.x() * q.x() + q.z() * q.z());
+        double dxz = max(0.0, r - radius);
+        double dy = max(0.0, abs(q.y()) - height / 2);
+        double d = sqrt(dxz*dxz + dy*dy);
+        if (d > 0) {
+            double radial = r > 0 ? dxz / r : 0.0;
+            grad = vec3(radial * q.x(), q.y() < 0 ? -dy : dy, radial * q.z()) / d;
+        } else {
+            grad = normal(p);
+        }
+        return d;
+    }
+
+private:
+    double height;
+    double radius;
+};
+
+class static_capsule : public static_leaf<static_capsule> {
+public:
+    static_capsule(const point3& _p1, const point3& _p2, double _radius, const color& _diffuse_color = color(1))
+        : static_leaf(_p1, _diffuse_color), v(unit_vector(_p2 - _p1)), length((_p2 - _p1).length()),
+          radius(_radius) {}
+
+    static_capsule(const point3& _p, const vec3& _dir, double _length, double _radius,
+                   const color& _diffuse_color = color(1))
+        : static_leaf(_p, _diffuse_color), v(_dir), length(_length), radius(_radius) {}
+
+    double sdf(const vec3& p) const {
+        double lambda = clamp(dot(p - pos, v), 0.0, length);
+        return ((pos + lambda * v) - p).length() - radius;
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const {
+        doublex4 lambda = vclamp(dot(p - pos, v), doublex4(0.0), doublex4(length));
+        return ((lambda * v + pos) - p).length() - doublex4(radius);
+    }
+
+    vec3 normal(const vec3& p) const {
+        double lambda = clamp(dot(p - pos, v), 0.0, length);
+        return unit_vector(p - (pos + lambda * v));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        double lambda = clamp(dot(p - pos, v), 0.0, length);
+        vec3 q = p - (pos + lambda * v);
+        double l = q.length();
+        grad = q / l;
+        return l - radius;
+    }
+
+private:
+    vec3 v;
+    double length;
+    double radius;
+};
+
+class static_ground_plane : public static_leaf<static_ground_plane> {
+public:
+    explicit static_ground_plane(double _height, const color& _diffuse_color = color(1))
+        : static_leaf(vec3(0, _height, 0), _diffuse_color) {}
+
+    double sdf(const vec3& p) const { return p.y() - pos.y(); }
+    doublex4 sdf_x4(const vec3x4& p) const { return p.y() - doublex4(pos.y()); }
+    vec3 normal(const vec3& /*p*/) const { return vec3(0, 1, 0); }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        grad = vec3(0, 1, 0);
+        return sdf(p);
+    }
+};
+
+/**************************
+ *   Static Composites    *
+ **************************/
+
+template<typename shape>
+class static_padded : public static_sdf<static_padded<shape>> {
+public:
+    static_padded(const shape& _obj, double _padding) : obj(_obj), padding(_padding) {}
+
+    double sdf(const vec3& p) const { return obj.sdf(p) - padding; }
+    doublex4 sdf_x4(const vec3x4& p) const { return obj.sdf_x4(p) - doublex4(padding); }
+    color diffuse_color(const vec3& p) const { return obj.diffuse_color(p); }
+    double sdf_grad(const vec3& p, vec3& grad) const { return obj.sdf_grad(p, grad) - padding; }
+
+    vec3 normal(const vec3& p) const {
+        vec3 grad;
+        sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+private:
+    shape obj;
+    double padding;
+};
+
+/**
+ * Base of static composites: two child shapes evaluated relative to the composite's position
+ */
+template<typename derived, typename shape1, typename shape2>
+class static_composite : public static_sdf<derived> {
+public:
+    static_composite(const point3& _pos, const shape1& _o1, const shape2& _o2) : pos(_pos), o1(_o1), o2(_o2) {}
+
+    color diffuse_color(const vec3& p) const {
+        vec3 q = p - pos;
+        if (o1.sdf(q) < o2.sdf(q)) return o1.diffuse_color(q);
+        else return o2.diffuse_color(q);
+    }
+
+    /**
+     * Normal of the combined surface, taken from the gradient of the child that determines the distance at p
+     */
+    vec3 normal(const vec3& p) const {
+        vec3 grad;
+        this->self().sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+protected:
+    point3 pos;
+    shape1 o1;
+    shape2 o2;
+};
+
+template<typename shape1, typename shape2>
+class static_diff : public static_composite<static_diff<shape1, shape2>, shape1, shape2> {
+public:
+    static_diff(const point3& _pos, const shape1& _o1, const shape2& _o2)
+        : static_composite<static_diff<shape1, shape2>, shape1, shape2>(_pos, _o1, _o2) {}
+
+    double sdf(const vec3& p) const {
+        return max(this->o1.sdf(p - this->pos), -(this->o2.sdf(p - this->pos)));
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const {
+        return vmax(this->o1.sdf_x4(p - this->pos), -(this->o2.sdf_x4(p - this->pos)));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        vec3 grad2;
+        double d1 = this->o1.sdf_grad(p - this->pos, grad);
+        double d2 = this->o2.sdf_grad(p - this->pos, grad2);
+        if (d1 < -d2) {
+            grad = -grad2;
+            return -d2;
+        }
+        return d1;
+    }
+};
+
+template<typename shape1, typename shape2>
+class static_union : public static_composite<static_union<shape1, shape2>, shape1, shape2> {
+public:
+    static_union(const point3& _pos, const shape1& _o1, const shape2& _o2)
+        : static_composite<static_union<shape1, shape2>, shape1, shape2>(_pos, _o1, _o2) {}
+
+    double sdf(const vec3& p) const {
+        return min(this->o1.sdf(p - this->pos), this->o2.sdf(p - this->pos));
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const {
+        return vmin(this->o1.sdf_x4(p - this->pos), this->o2.sdf_x4(p - this->pos));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        vec3 grad2;
+        double d1 = this->o1.sdf_grad(p - this->pos, grad);
+        double d2 = this->o2.sdf_grad(p - this->pos, grad2);
+        if (d2 < d1) {
+            grad = grad2;
+            return d2;
+        }
+        return d1;
+    }
+};
+
+template<typename shape1, typename shape2>
+class static_intersect : public static_composite<static_intersect<shape1, shape2>, shape1, shape2> {
+public:
+    static_intersect(const point3& _pos, const shape1& _o1, const shape2& _o2)
+        : static_composite<static_intersect<shape1, shape2>, shape1, shape2>(_pos, _o1, _o2) {}
+
+    double sdf(const vec3& p) const {
+        return max(this->o1.sdf(p - this->pos), this->o2.sdf(p - this->pos));
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const {
+        return vmax(this->o1.sdf_x4(p - this->pos), this->o2.sdf_x4(p - this->pos));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const {
+        vec3 grad2;
+        double d1 = this->o1.sdf_grad(p - this->pos, grad);
+        double d2 = this->o2.sdf_grad(p - this->pos, grad2);
+        if (d1 < d2) {
+            grad = grad2;
+            return d2;
+        }
+        return d1;
+    }
+};
+
+/**
+ * Adapter that puts a static shape into a dynamic scene. The whole shape costs a single virtual call per evaluation
+ * @tparam shape Static shape type
+ */
+template<typename shape>
+class sdf_static_object : public sdf_object {
+public:
+    explicit sdf_static_object(const shape& _obj) : obj(_obj) {}
+
+    double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return obj.sdf(p);
+    }
+
+    doublex4 sdf_x4(const vec3x4& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        return obj.sdf_x4(p);
+    }
+
+    vec3 normal(const vec3& p) const override { return obj.normal(p); }
+    double sdf_grad(const vec3& p, vec3& grad) const override { return obj.sdf_grad(p, grad); }
+    color get_diffuse_color(point3& p) const override { return obj.diffuse_color(p); }
+
+    const shape& get_shape() const { return obj; }
+
+private:
+    shape obj;
+};
+
+#endif //CPU_RAYMARCHER_STATIC_OBJECTS_H
@@ -0,0 +1,226 @@
+#ifndef CPU_RAYMARCHER_WARP_H
+#define CPU_RAYMARCHER_WARP_H
+
+#include "objects.h"
+
+/**
+ * Base of nodes that deform a single child object by evaluating it at warped points. Warps stretch the distance
+ * field, so they report a Lipschitz bound above 1 instead of shrinking their distances, see sdf_object::lipschitz()
+ */
+class sdf_warp : public sdf_object {
+public:
+    explicit sdf_warp(sdf_object* _obj) : obj(_obj) {}
+
+    double sdf(const vec3& p) const override {
+        SDF_PROFILE_SCOPE(this);
+        double far = far_field(p);
+        if (far > 0) return far;
+        return factor * obj->sdf(warp(p));
+    }
+
+    double sdf_grad(const vec3& p, vec3& grad) const override {
+        double d = factor * obj->sdf_grad(warp(p), grad);
+        grad = factor * pullback(p, grad);
+        double far = far_field(p);
+        return far > 0 ? far : d;
+    }
+
+    double sdf_leaf(const vec3& p, sdf_hit& hit) const override {
+        double d = factor * obj->sdf_leaf(warp(p), hit);
+        for (auto& axis : hit.axes) axis = pullback(p, axis);
+        double far = far_field(p);
+        return far > 0 ? far : d;
+    }
+
+    vec3 normal(const vec3& p) const override {
+        vec3 grad;
+        sdf_grad(p, grad);
+        return unit_vector(grad);
+    }
+
+    color get_diffuse_color(point3& p) const override {
+        point3 q = warp(p);
+        return obj->get_diffuse_color(q);
+    }
+
+    void disown_children() override { owns_children = false; }
+
+    ~sdf_warp() {
+        if (owns_children) delete obj;
+    }
+
+protected:
+    /**
+     * Maps a point into the child's space
+     * @param p Point in the node's parent space
+     * @return Point the child is evaluated at
+     */
+    virtual vec3 warp(const vec3& p) const = 0;
+
+    /**
+     * Maps a gradient of the child back into the node's parent space, i.e. multiplies it with the transposed
+     * Jacobian of warp() at p
+     * @param p Point in the node's parent space
+     * @param v Gradient in the child's space
+     * @return Gradient in the node's parent space
+     */
+    virtual vec3 pullback(const vec3& p, const vec3& v) const = 0;
+
+    /**
+     * Distance for points far away from the warped child, where the Lipschitz bound of the warp doesn't hold and
+     * the child isn't evaluated at all. This default implementation never applies
+     * @param p Point in the node's parent space
+     * @return Lower bound of the distance to the surface times lipschitz(), or 0 to evaluate the child
+     */
+    virtual double far_field(const vec3& /*p*/) const { return 0; }
+
+protected:
+    sdf_object* obj;
+    bool owns_children = true;
+
+    /**
+     * Scale of the child's distances
+     */
+    double factor = 1;
+};
+
+/**
+ * Twists a child object around the y axis, rotating its cross sections by an angle proportional to their height.
+ * The Lipschitz bound grows with the twist rate and the child's distance from the y axis, so the child must be
+ * bounded
+ */
+class sdf_twist : public sdf_warp {
+public:
+    /**
+     * @param _obj Child object
+     * @param _rate Rotation in radians per unit of height
+     */
+    sdf_twist(sdf_object* _obj, double _rate) : sdf_warp(_obj), rate(_rate) {
+        aabb child = obj->bounds();
+        double x = max(abs(child.min_corner().x()), abs(child.max_corner().x()));
+        double z = max(abs(child.min_corner().z()), abs(child.max_corner().z()));
+        radius = sqrt(x * x + z * z);
+
+        // The Jacobian is a rotation times a shear of strength rate * r, whose largest singular value is
+        // (s + sqrt(s^2 + 4)) / 2
+        double s = abs(rate) * radius;
+        lipschitz_bound = obj->lipschitz() * (s + sqrt(s * s + 4)) / 2;
+    }
+
+    aabb bounds() const override {
+        aabb child = obj->bounds();
+        return aabb(vec3(-radius, child.min_corner().y(), -radius), vec3(radius, child.max_corner().y(), radius));
+    }
+
+protected:
+    vec3 warp(const vec3& p) const override {
+        double s = std::sin(rate * p.y()), c = std::cos(rate * p.y());
+        return vec3(c * p.x() - s * p.z(), p.y(), s * p.x() + c * p.z());
+    }
+
+    vec3 pullback(const vec3& p, const vec3& v) const override {
+        double s = std::sin(rate * p.y()), c = std::cos(rate * p.y());
+        vec3 q = warp(p);
+        return vec3(c * v.x() + s * v.z(), v.y() + rate * (q.x() * v.z() - q.z() * v.x()), c * v.z() - s * v.x());
+    }
+
+    double far_field(const vec3& p) const override {
+        // Twisting keeps the distance from the y axis, so the surface stays inside the cylinder around the child
+        double r = sqrt(p.x() * p.x() + p.z() * p.z());
+        return r > radius ? lipschitz_bound * (r - radius) : 0;
+    }
+
+private:
+    double rate;
+
+    /**
+     * Largest distance of the child's bounds from the y axis
+     */
+    double radius;
+};
+
+/**
+ * Bends a child object around the z axis, rotating it in the xy plane by an angle proportional to x. The Lipschitz
+ * bound grows with the bend rate and the child's distance from the z axis, so the child must be bounded
+ */
+class sdf_bend : public sdf_warp {
+public:
+    /**
+     * @param _obj Child object
+     * @param _rate Rotation in radians per unit along the x axis
+     */
+    sdf_bend(sdf_object* _obj, double _rate) : sdf_warp(_obj), rate(_rate) {
+        aabb child = obj->bounds();
+        double x = max(abs(child.min_corner().x()), abs(child.max_corner().x()));
+        double y = max(abs(child.min_corner().y()), abs(child.max_corner().y()));
+        radius = sqrt(x * x + y * y);
+        lipschitz_bound = obj->lipschitz() * (1 + abs(rate) * radius);
+    }
+
+    aabb bounds() const override {
+        aabb child = obj->bounds();
+        return aabb(vec3(-radius, -radius, child.min_corner().z()), vec3(radius, radius, child.max_corner().z()));
+    }
+
+protected:
+    vec3 warp(const vec3& p) const override {
+        double s = std::sin(rate * p.x()), c = std::cos(rate * p.x());
+        return vec3(c * p.x() - s * p.y(), s * p.x() + c * p.y(), p.z());
+    }
+
+    vec3 pullback(const vec3& p, const vec3& v) const override {
+        double s = std::sin(rate * p.x()), c = std::cos(rate * p.x());
+        vec3 q = warp(p);
+        return vec3(c * v.x() + s * v.y() + rate * (q.x() * v.y() - q.y() * v.x()), c * v.y() - s * v.x(), v.z());
+    }
+
+    double far_field(const vec3& p) const override {
+        // Bending keeps the distance from the z axis, so the surface stays inside the cylinder around the child
+        double r = sqrt(p.x() * p.x() + p.y() * p.y());
+        return r > radius ? lipschitz_bound * (r - radius) : 0;
+    }
+
+private:
+    double rate;
+
+    /**
+     * Largest distance of the child's bounds from the z axis
+     */
+    double radius;
+};
+
+/**
+ * Scales a child object by a different factor along each axis. Distances are scaled by the largest factor, which
+ * is exact along that axis and overestimates along the others by up to the ratio of the largest and smallest
+ * factor, which becomes the Lipschitz bound
+ */
+class sdf_scale : public sdf_warp {
+public:
+    /**
+     * @param _obj Child object
+     * @param _scale Scale factor along each axis, > 0
+     */
+    sdf_scale(sdf_object* _obj, const vec3& _scale) : sdf_warp(_obj), scale(_scale),
+        inv_scale(1 / _scale.x(), 1 / _scale.y(), 1 / _scale.z()) {
+        double largest = max(scale.x(), max(scale.y(), scale.z()));
+        double smallest = min(scale.x(), min(scale.y(), scale.z()));
+        factor = largest;
+        lipschitz_bound = obj->lipschitz() * largest / smallest;
+    }
+
+    aabb bounds() const override {
+        aabb child = obj->bounds();
+        return aabb(child.min_corner() * scale, child.max_corner() * scale);
+    }
+
+protected:
+    vec3 warp(const vec3& p) const override { return p * inv_scale; }
+
+    vec3 pullback(const vec3& /*p*/, const vec3& v) const override { return v * inv_scale; }
+
+private:
+    vec3 scale;
+    vec3 inv_scale;
+};
+
+#endif //CPU_RAYMARCHER_WARP_H
@@ -0,0 +1,32 @@
+#ifndef CPU_RAYMARCHER_STATIC_RAY_MARCH_SHADER_H
+#define CPU_RAYMARCHER_STATIC_RAY_MARCH_SHADER_H
+
+#include "ray_march_shader.h"
+#include "raymarch/static_objects.h"
+
+/**
+ * Ray-marching shader for a scene whose geometry is known at compile time. The static shape is added to a copy of
+ * the scene as a single sdf_static_object, so every march step evaluates the complete, inlined distance function
+ * with one virtual call. Any dynamic objects and light sources of the given scene are kept
+ * @tparam shape Static shape type, see static_objects.h
+ * @tparam shader_type Ray-marching shader that does the shading, e.g. ray_march_test_shader
+ */
+template<typename shape, typename shader_type>
+class static_ray_march_shader : public shader_type {
+public:
+    static_ray_march_shader(const std::shared_ptr<const scene>& _scn, const shape& _shape)
+        : shader_type(with_shape(_scn, _shape)) {}
+
+private:
+    /**
+     * @return Scene with the objects and light sources of scn plus the static shape
+     */
+    static std::shared_ptr<const scene> with_shape(const std::shared_ptr<const scene>& scn, const shape& _shape) {
+        scene_builder builder;
+        builder.include(scn);
+        builder += builder.make<sdf_static_object<shape>>(_shape);
+        return builder.freeze();
+    }
+};
+
+#endif //CPU_RAYMARCHER_STATIC_RAY_MARCH_SHADER_H
@@ -0,0 +1,128 @@
+#ifndef CPU_RAYMARCHER_AABB_H
+#define CPU_RAYMARCHER_AABB_H
+
+#include <limits>
+#include "vec3.h"
+#include "vec3x4.h"
+
+/**
+ * Axis aligned bounding box. A box with infinite extent is used for objects that can't be bounded
+ */
+class aabb {
+public:
+    /**
+     * Creates an empty box that contains no point
+     */
+    aabb() : lo(std::numeric_limits<double>::infinity()), hi(-std::numeric_limits<double>::infinity()) {}
+
+    /**
+     * Creates a box from its corners
+     * @param _lo Corner with the smallest coordinates
+     * @param _hi Corner with the largest coordinates
+     */
+    aabb(const point3& _lo, const point3& _hi) : lo(_lo), hi(_hi) {}
+
+    /**
+     * @return Box that contains all of space
+     */
+    static aabb infinite() {
+        return aabb(vec3(-std::numeric_limits<double>::infinity()), vec3(std::numeric_limits<double>::infinity()));
+    }
+
+    /**
+     * @param center Center of the box
+     * @param half_extent Half of the edge lengths of the box
+     * @return Box around center
+     */
+    static aabb around(const point3& center, const vec3& half_extent) {
+        return aabb(center - half_extent, center + half_extent);
+    }
+
+    const point3& min_corner() const { return lo; }
+    const point3& max_corner() const { return hi; }
+    point3 center() const { return 0.5 * (lo + hi); }
+    vec3 extent() const { return hi - lo; }
+
+    bool empty() const { return lo.x() > hi.x() || lo.y() > hi.y() || lo.z() > hi.z(); }
+
+    /**
+     * @return Whether the box has a finite extent
+     */
+    bool bounded() const {
+        return std::isfinite(lo.x()) && std::isfinite(lo.y()) && std::isfinite(lo.z())
+               && std::isfinite(hi.x()) && std::isfinite(hi.y()) && std::isfinite(hi.z());
+    }
+
+    /**
+     * @return Index of the axis along which the box is largest
+     */
+    int longest_axis() const {
+        vec3 e = extent();
+        if (e.x() >= e.y() && e.x() >= e.z()) return 0;
+        return e.y() >= e.z() ? 1 : 2;
+    }
+
+    /**
+     * Calculates the distance from a point to the box. Points inside the box have distance 0. For any object
+     * enclosed by the box this is a lower bound of the object's distance
+     * @param p Point in world space
+     * @return Distance from p to the closest point of the box
+     */
+    double distance(const point3& p) const {
+        double dx = std::fmax(0.0, std::fmax(lo.x() - p.x(), p.x() - hi.x()));
+        double dy = std::fmax(0.0, std::fmax(lo.y() - p.y(), p.y() - hi.y()));
+        double dz = std::fmax(0.0, std::fmax(lo.z() - p.z(), p.z() - hi.z()));
+        return sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    /**
+     * Calculates the distances from four points to the box, see distance
+     */
+    doublex4 distance_x4(const vec3x4& p) const {
+        doublex4 zero(0.0);
+        doublex4 dx = vmax(zero, vmax(doublex4(lo.x()) - p.x(), p.x() - doublex4(hi.x())));
+        doublex4 dy = vmax(zero, vmax(doublex4(lo.y()) - p.y(), p.y() - doublex4(hi.y())));
+        doublex4 dz = vmax(zero, vmax(doublex4(lo.z()) - p.z(), p.z() - doublex4(hi.z())));
+        return vsqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    /**
+     * @return Whether p lies inside the box
+     */
+    bool contains(const point3& p) const {
+        return p.x() >= lo.x() && p.y() >= lo.y() && p.z() >= lo.z()
+               && p.x() <= hi.x() && p.y() <= hi.y() && p.z() <= hi.z();
+    }
+
+    /**
+     * @return Box grown by d into every direction
+     */
+    aabb expanded(double d) const { return aabb(lo - vec3(d), hi + vec3(d)); }
+
+    /**
+     * @return Box moved by offset
+     */
+    aabb translated(const vec3& offset) const { return aabb(lo + offset, hi + offset); }
+
+    /**
+     * @return Smallest box that contains both a and b
+     */
+    static aabb merge(const aabb& a, const aabb& b) {
+        return aabb(vec3(std::fmin(a.lo.x(), b.lo.x()), std::fmin(a.lo.y(), b.lo.y()), std::fmin(a.lo.z(), b.lo.z())),
+                    vec3(std::fmax(a.hi.x(), b.hi.x()), std::fmax(a.hi.y(), b.hi.y()), std::fmax(a.hi.z(), b.hi.z())));
+    }
+
+    /**
+     * @return Largest box that is contained in both a and b
+     */
+    static aabb intersect(const aabb& a, const aabb& b) {
+        return aabb(vec3(std::fmax(a.lo.x(), b.lo.x()), std::fmax(a.lo.y(), b.lo.y()), std::fmax(a.lo.z(), b.lo.z())),
+                    vec3(std::fmin(a.hi.x(), b.hi.x()), std::fmin(a.hi.y(), b.hi.y()), std::fmin(a.hi.z(), b.hi.z())));
+    }
+
+private:
+    point3 lo;
+    point3 hi;
+};
+
+#endif //CPU_RAYMARCHER_AABB_H
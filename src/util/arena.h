@@ -0,0 +1,99 @@
+#ifndef CPU_RAYMARCHER_ARENA_H
+#define CPU_RAYMARCHER_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Bump allocator that places objects next to each other in large blocks of memory. Objects can't be freed one by
+ * one; they are all destroyed, in reverse order of creation, when the arena is destroyed
+ */
+class arena {
+public:
+    /**
+     * @param _block_size Size in bytes of the memory blocks. Objects are allocated from a single block as long as
+     * they fit into it
+     */
+    explicit arena(size_t _block_size = 64 * 1024) : block_size(_block_size) {}
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena() {
+        for (destructor* d = destructors; d != nullptr; d = d->next) d->destroy(d->object);
+        while (blocks != nullptr) {
+            block* next = blocks->next;
+            ::operator delete(blocks);
+            blocks = next;
+        }
+    }
+
+    /**
+     * Constructs an object inside of the arena
+     * @tparam T Type of the object
+     * @param args Constructor arguments
+     * @return Pointer to the object, valid until the arena is destroyed. Must not be deleted
+     */
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            // The destructor list lives in the arena as well
+            destructors = new (allocate(sizeof(destructor), alignof(destructor)))
+                    destructor {[](void* p) { static_cast<T*>(p)->~T(); }, object, destructors};
+        }
+        return object;
+    }
+
+    /**
+     * @return Number of bytes handed out so far, including alignment padding
+     */
+    size_t used() const { return used_bytes; }
+
+    /**
+     * @return Number of memory blocks allocated from the heap
+     */
+    int block_count() const { return blocks_allocated; }
+
+private:
+    struct block {
+        block* next;
+    };
+
+    struct destructor {
+        void (*destroy)(void*);
+        void* object;
+        destructor* next;
+    };
+
+    void* allocate(size_t size, size_t alignment) {
+        uintptr_t p = (cursor + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        if (blocks == nullptr || p + size > end) {
+            size_t capacity = size + alignment > block_size ? size + alignment : block_size;
+            auto* b = static_cast<block*>(::operator new(sizeof(block) + capacity));
+            b->next = blocks;
+            blocks = b;
+            blocks_allocated++;
+            cursor = reinterpret_cast<uintptr_t>(b + 1);
+            end = cursor + capacity;
+            p = (cursor + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        }
+        used_bytes += p + size - cursor;
+        cursor = p + size;
+        return reinterpret_cast<void*>(p);
+    }
+
+private:
+    size_t block_size;
+    block* blocks = nullptr;
+    uintptr_t cursor = 0;
+    uintptr_t end = 0;
+    size_t used_bytes = 0;
+    int blocks_allocated = 0;
+    destructor* destructors = nullptr;
+};
+
+#endif //CPU_RAYMARCHER_ARENA_H
@@ -0,0 +1,52 @@
+#ifndef CPU_RAYMARCHER_COST_COUNTERS_H
+#define CPU_RAYMARCHER_COST_COUNTERS_H
+
+/**
+ * Running totals of the work done by the ray marcher on one thread. The marcher only ever adds to them; whoever wants
+ * the cost of a piece of work reads the totals before and after it and takes the difference, see renderer. Counting
+ * is off by default and switched per thread, so the marcher only touches the counters while a measured frame is
+ * rendered on its thread
+ */
+struct cost_counters {
+    /**
+     * March steps of all rays, including shadow rays. A step of a ray packet counts once for every lane it advances
+     */
+    long steps = 0;
+
+    /**
+     * Distance evaluations of top-level objects. An evaluation of a packet counts once for every lane
+     */
+    long sdf_evals = 0;
+
+    /**
+     * @return The counters of the calling thread
+     */
+    static cost_counters& local() {
+        static thread_local cost_counters counters;
+        return counters;
+    }
+
+    /**
+     * @return The counters of the calling thread if counting is on for it, otherwise nullptr
+     */
+    static cost_counters* counting() {
+        cost_counters& counters = local();
+        return counters.active ? &counters : nullptr;
+    }
+
+    /**
+     * @return Whether the marcher counts its work on the calling thread
+     */
+    static bool enabled() { return local().active; }
+
+    /**
+     * Switches counting on or off for the calling thread. The workers of a render_pool switch it on for the tiles
+     * of frames with a cost_map and off for all others
+     */
+    static void set_enabled(bool on) { local().active = on; }
+
+private:
+    bool active = false;
+};
+
+#endif //CPU_RAYMARCHER_COST_COUNTERS_H
@@ -0,0 +1,27 @@
+#ifndef CPU_RAYMARCHER_PARALLEL_H
+#define CPU_RAYMARCHER_PARALLEL_H
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * Splits [0, count) into contiguous ranges and processes them on separate, short-lived threads. Meant for one-off
+ * precomputations, frames are rendered through a render_pool
+ * @param count Number of items
+ * @param threads Number of threads. Values below 1 select std::thread::hardware_concurrency()
+ * @param job Function (int begin, int end) that processes the items of one range
+ */
+inline void parallel_for(int count, int threads, const std::function<void(int, int)>& job) {
+    if (threads < 1) threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (threads < 1) threads = 1;
+    if (threads > count) threads = count;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(job, count * i / threads, count * (i + 1) / threads);
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+#endif //CPU_RAYMARCHER_PARALLEL_H
@@ -0,0 +1,278 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> perf_monitor::active {false};
+
+/**
+ * Spans of one phase on one thread
+ */
+struct perf_phase_totals {
+    explicit perf_phase_totals(const char* _phase) : phase(_phase) {}
+
+    const char* phase;
+
+    /**
+     * Counts by perf_event_kind, each span scaled by the share of it its counters ran
+     */
+    double events[perf_sample::EVENT_COUNT] = {};
+    std::uint64_t nanoseconds = 0;
+    long spans = 0;
+};
+
+/**
+ * Counters and recorded phases of one thread. Only written by that thread, and only read by others between frames
+ */
+struct perf_thread {
+    explicit perf_thread(int _index) : index(_index) {}
+
+    ~perf_thread() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    int index;
+    std::string name;
+
+    /**
+     * File descriptors of the counters by perf_event_kind, -1 for counters that couldn't be opened. The first open
+     * counter leads the group, which is read at once
+     */
+    int fds[perf_sample::EVENT_COUNT] = {-1, -1, -1, -1};
+    int leader = -1;
+
+    /**
+     * Position of each counter in the values of a group read, -1 for counters that aren't open
+     */
+    int slots[perf_sample::EVENT_COUNT] = {-1, -1, -1, -1};
+    bool opened = false;
+
+    std::vector<perf_phase_totals> phases;
+};
+
+static std::mutex registry_lock;
+static std::vector<std::shared_ptr<perf_thread>> registry;
+
+/**
+ * Why counters couldn't be opened, empty if all threads got all of them
+ */
+static std::string unavailable_reason;
+
+#ifdef __linux__
+/**
+ * Opens a counter of the calling thread that only counts in user space
+ * @param config PERF_COUNT_HW_* event
+ * @param group_fd Leader of the group, -1 to open a new group
+ * @return File descriptor of the counter, -1 on failure with errno set
+ */
+static int open_counter(std::uint64_t config, int group_fd) {
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+/**
+ * Opens the counters of a thread. Counters the system doesn't allow or support are left out
+ */
+static void open_counters(perf_thread& t) {
+    t.opened = true;
+    std::string reason;
+#ifdef __linux__
+    static const std::uint64_t configs[perf_sample::EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES};
+    static const char* names[perf_sample::EVENT_COUNT] = {"cycles", "instructions", "cache misses", "branch misses"};
+
+    int slot = 0;
+    bool denied = false;
+    for (int i = 0; i < perf_sample::EVENT_COUNT; i++) {
+        int fd = open_counter(configs[i], t.leader);
+        if (fd < 0) {
+            denied = denied || errno == EACCES || errno == EPERM;
+            if (!reason.empty()) reason += ", ";
+            reason += std::string(names[i]) + ": " + std::strerror(errno);
+            continue;
+        }
+        t.fds[i] = fd;
+        t.slots[i] = slot++;
+        if (t.leader < 0) t.leader = fd;
+    }
+    if (denied) reason += " (see /proc/sys/kernel/perf_event_paranoid)";
+    if (t.leader < 0 && !denied) reason += " (no hardware counters exposed, e.g. in a virtual machine)";
+#else
+    reason = "perf_event_open is only available on Linux";
+#endif
+    if (!reason.empty()) {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        if (unavailable_reason.empty()) unavailable_reason = reason;
+    }
+}
+
+/**
+ * @return State of the calling thread, registered on first use. It outlives the thread
+ */
+static perf_thread& local_thread() {
+    thread_local std::shared_ptr<perf_thread> state = []() {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        auto created = std::make_shared<perf_thread>(static_cast<int>(registry.size()));
+        registry.push_back(created);
+        return created;
+    }();
+    return *state;
+}
+
+void perf_monitor::set_thread_name(const std::string& name) {
+    perf_thread& t = local_thread();
+    std::lock_guard<std::mutex> guard(registry_lock);
+    t.name = name;
+}
+
+void perf_monitor::sample(perf_sample& out) {
+    perf_thread& t = local_thread();
+    if (!t.opened) open_counters(t);
+
+#ifdef __linux__
+    if (t.leader >= 0) {
+        // Group read: number of counters, time enabled, time running, one value per counter
+        std::uint64_t values[3 + perf_sample::EVENT_COUNT];
+        if (read(t.leader, values, sizeof(values)) >= static_cast<ssize_t>(3 * sizeof(std::uint64_t))) {
+            out.time_enabled = values[1];
+            out.time_running = values[2];
+            for (int i = 0; i < perf_sample::EVENT_COUNT; i++) {
+                if (t.slots[i] < 0 || static_cast<std::uint64_t>(t.slots[i]) >= values[0]) continue;
+                out.events[i] = values[3 + t.slots[i]];
+            }
+        }
+    }
+#endif
+    out.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void perf_monitor::record(const char* phase, const perf_sample& begin) {
+    perf_sample end;
+    sample(end);
+
+    perf_thread& t = local_thread();
+    perf_phase_totals* totals = nullptr;
+    for (auto& p : t.phases) {
+        if (p.phase == phase || std::strcmp(p.phase, phase) == 0) totals = &p;
+    }
+    if (totals == nullptr) {
+        t.phases.emplace_back(phase);
+        totals = &t.phases.back();
+    }
+
+    // Counters that had to share the hardware with others only ran part of the span, scale them up. The scale has
+    // to come from the span itself, the share of the time they ran changes over the lifetime of the counters
+    std::uint64_t enabled = end.time_enabled - begin.time_enabled;
+    std::uint64_t running = end.time_running - begin.time_running;
+    double scale = running > 0 && running < enabled ? static_cast<double>(enabled) / running : 1;
+    for (int i = 0; i < perf_sample::EVENT_COUNT; i++) {
+        totals->events[i] += static_cast<double>(end.events[i] - begin.events[i]) * scale;
+    }
+    totals->nanoseconds += end.nanoseconds - begin.nanoseconds;
+    totals->spans++;
+}
+
+void perf_monitor::reset() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    for (auto& t : registry) t->phases.clear();
+}
+
+/**
+ * Writes one row of the report
+ * @param counted Whether each event was counted for all spans of the row
+ */
+static void print_row(std::ostream& out, const std::string& thread, const char* phase, const perf_phase_totals& p,
+                      const bool counted[]) {
+    char line[256];
+    char cells[perf_sample::EVENT_COUNT][16];
+    for (int i = 0; i < perf_sample::EVENT_COUNT; i++) {
+        if (counted[i]) std::snprintf(cells[i], sizeof(cells[i]), "%.2f", p.events[i] / 1e6);
+        else std::snprintf(cells[i], sizeof(cells[i]), "-");
+    }
+    char ipc[16] = "-";
+    if (counted[0] && counted[1] && p.events[0] > 0) {
+        std::snprintf(ipc, sizeof(ipc), "%.2f", p.events[1] / p.events[0]);
+    }
+    std::snprintf(line, sizeof(line), "%-18.18s %-14.14s %7ld %10.2f %10s %10s %6s %12s %12s\n", thread.c_str(), phase,
+                  p.spans, p.nanoseconds / 1e6, cells[0], cells[1], ipc, cells[2], cells[3]);
+    out << line;
+}
+
+void perf_monitor::report(std::ostream& out, long rays) {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    if (!unavailable_reason.empty()) {
+        out << "Hardware counters unavailable, their columns are left empty: " << unavailable_reason << std::endl;
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-18s %-14s %7s %10s %10s %10s %6s %12s %12s\n", "thread", "phase", "spans",
+                  "time ms", "Mcycles", "Minstr", "IPC", "Mcache-miss", "Mbranch-miss");
+    out << line;
+
+    // Totals per phase, in order of first appearance
+    std::vector<perf_phase_totals> totals;
+    std::vector<std::vector<bool>> totals_counted;
+    for (const auto& t : registry) {
+        bool counted[perf_sample::EVENT_COUNT];
+        for (int i = 0; i < perf_sample::EVENT_COUNT; i++) counted[i] = t->slots[i] >= 0;
+        std::string thread = t->name.empty() ? "thread " + std::to_string(t->index) : t->name;
+
+        for (const auto& p : t->phases) {
+            print_row(out, thread, p.phase, p, counted);
+
+            size_t j = 0;
+            while (j < totals.size() && std::strcmp(totals[j].phase, p.phase) != 0) j++;
+            if (j == totals.size()) {
+                totals.emplace_back(p.phase);
+                totals_counted.emplace_back(counted, counted + perf_sample::EVENT_COUNT);
+            }
+            for (int i = 0; i < perf_sample::EVENT_COUNT; i++) {
+                totals[j].events[i] += p.events[i];
+                totals_counted[j][i] = totals_counted[j][i] && counted[i];
+            }
+            totals[j].nanoseconds += p.nanoseconds;
+            totals[j].spans += p.spans;
+        }
+    }
+
+    for (size_t j = 0; j < totals.size(); j++) {
+        bool counted[perf_sample::EVENT_COUNT];
+        for (int i = 0; i < perf_sample::EVENT_COUNT; i++) counted[i] = totals_counted[j][i];
+        print_row(out, "total", totals[j].phase, totals[j], counted);
+
+        if (rays <= 0 || std::strcmp(totals[j].phase, "render") != 0) continue;
+        static const char* names[perf_sample::EVENT_COUNT] = {"cycles", "instructions", "cache misses",
+                                                              "branch misses"};
+        out << "Per ray (" << rays << " primary rays):";
+        for (int i = 0; i < perf_sample::EVENT_COUNT; i++) {
+            if (!counted[i]) continue;
+            std::snprintf(line, sizeof(line), " %.1f %s,", totals[j].events[i] / rays, names[i]);
+            out << line;
+        }
+        std::snprintf(line, sizeof(line), " %.0f ns of worker time\n", totals[j].nanoseconds / double(rays));
+        out << line;
+    }
+}
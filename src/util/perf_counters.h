@@ -0,0 +1,131 @@
+#ifndef CPU_RAYMARCHER_PERF_COUNTERS_H
+#define CPU_RAYMARCHER_PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Hardware events counted by the perf_monitor
+ */
+enum class perf_event_kind {
+    cycles,
+    instructions,
+    cache_misses,
+    branch_misses
+};
+
+/**
+ * Counter readings and the wall clock of one thread at one point in time
+ */
+struct perf_sample {
+    static constexpr int EVENT_COUNT = 4;
+
+    /**
+     * Raw counts by perf_event_kind, as read from the counters
+     */
+    std::uint64_t events[EVENT_COUNT] = {};
+
+    /**
+     * Nanoseconds the counters were enabled and actually counting. They only count part of the time they are enabled
+     * when they share the hardware with other counters
+     */
+    std::uint64_t time_enabled = 0;
+    std::uint64_t time_running = 0;
+
+    std::uint64_t nanoseconds = 0;
+};
+
+/**
+ * Collects hardware performance counters per thread and per phase of the program, e.g. cycles, instructions and
+ * cache misses spent on rendering tiles, through the Linux perf_event_open interface. Every thread opens its own
+ * counters, which only count that thread in user space, and sums up its spans by phase without synchronization. The
+ * sums are only read by report, so no thread may record spans while that runs.
+ *
+ * Where the counters can't be opened, because the system isn't Linux, the kernel doesn't permit it (see
+ * /proc/sys/kernel/perf_event_paranoid) or the CPU doesn't expose them, the monitor still records wall times and the
+ * report says why the counts are missing. Recording is off by default
+ */
+class perf_monitor {
+public:
+    /**
+     * @return Whether spans are currently recorded
+     */
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void set_enabled(bool on) { active.store(on, std::memory_order_relaxed); }
+
+    /**
+     * Names the calling thread in the report
+     */
+    static void set_thread_name(const std::string& name);
+
+    /**
+     * Reads the current counts of the calling thread, opening its counters on first use
+     * @param out Receives the counts
+     */
+    static void sample(perf_sample& out);
+
+    /**
+     * Adds the counts since a sample to a phase of the calling thread. Counts of counters that only ran part of the
+     * span are scaled up to the whole span
+     * @param phase Name of the phase, a string literal
+     * @param begin Sample taken at the beginning of the span
+     */
+    static void record(const char* phase, const perf_sample& begin);
+
+    /**
+     * Discards all recorded spans of all threads
+     */
+    static void reset();
+
+    /**
+     * Writes the counts per thread and phase along with their instructions per cycle, followed by the totals per
+     * phase. The counts of the "render" phase are additionally given per ray
+     * @param out Output stream
+     * @param rays Number of primary rays of the rendered frames, 0 to leave out the counts per ray
+     */
+    static void report(std::ostream& out, long rays = 0);
+
+private:
+    static std::atomic<bool> active;
+};
+
+/**
+ * Records the lifetime of the scope it is declared in as a span of a phase, if the perf_monitor is enabled, see
+ * PERF_SCOPE
+ */
+class perf_scope {
+public:
+    /**
+     * @param _phase Name of the phase, a string literal
+     */
+    explicit perf_scope(const char* _phase) : phase(_phase) {
+        if (!perf_monitor::enabled()) return;
+        recording = true;
+        perf_monitor::sample(begin);
+    }
+
+    ~perf_scope() {
+        if (recording) perf_monitor::record(phase, begin);
+    }
+
+    perf_scope(const perf_scope&) = delete;
+    perf_scope& operator=(const perf_scope&) = delete;
+
+private:
+    const char* phase;
+    bool recording = false;
+    perf_sample begin;
+};
+
+#define PERF_SCOPE_JOIN(a, b) a##b
+#define PERF_SCOPE_NAME(line) PERF_SCOPE_JOIN(perf_scope_guard_, line)
+
+/**
+ * Records the rest of the enclosing scope as a span of a phase, see perf_scope
+ */
+#define PERF_SCOPE(phase) perf_scope PERF_SCOPE_NAME(__LINE__)(phase)
+
+#endif //CPU_RAYMARCHER_PERF_COUNTERS_H
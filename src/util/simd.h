@@ -0,0 +1,294 @@
+#ifndef CPU_RAYMARCHER_SIMD_H
+#define CPU_RAYMARCHER_SIMD_H
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CPU_RAYMARCHER_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CPU_RAYMARCHER_SIMD_SSE2
+#endif
+
+/**
+ * Lane mask of a doublex4 comparison. Each lane is either all bits set (true) or all bits cleared (false)
+ */
+struct maskx4;
+
+/**
+ * Four double lanes processed by a single instruction where the target supports it. Maps to one AVX register,
+ * two SSE2 registers or a plain array as a portable fallback
+ */
+struct doublex4 {
+    static constexpr int WIDTH = 4;
+
+#if defined(CPU_RAYMARCHER_SIMD_AVX)
+    __m256d v;
+
+    doublex4() : v(_mm256_setzero_pd()) {}
+    explicit doublex4(__m256d _v) : v(_v) {}
+    doublex4(double s) : v(_mm256_set1_pd(s)) {} // NOLINT(google-explicit-constructor)
+    doublex4(double a, double b, double c, double d) : v(_mm256_setr_pd(a, b, c, d)) {}
+
+    static doublex4 load(const double* src) { return doublex4(_mm256_loadu_pd(src)); }
+    void store(double* dst) const { _mm256_storeu_pd(dst, v); }
+#elif defined(CPU_RAYMARCHER_SIMD_SSE2)
+    __m128d lo, hi;
+
+    doublex4() : lo(_mm_setzero_pd()), hi(_mm_setzero_pd()) {}
+    doublex4(__m128d _lo, __m128d _hi) : lo(_lo), hi(_hi) {}
+    doublex4(double s) : lo(_mm_set1_pd(s)), hi(_mm_set1_pd(s)) {} // NOLINT(google-explicit-constructor)
+    doublex4(double a, double b, double c, double d) : lo(_mm_setr_pd(a, b)), hi(_mm_setr_pd(c, d)) {}
+
+    static doublex4 load(const double* src) { return doublex4(_mm_loadu_pd(src), _mm_loadu_pd(src + 2)); }
+    void store(double* dst) const { _mm_storeu_pd(dst, lo); _mm_storeu_pd(dst + 2, hi); }
+#else
+    double v[4];
+
+    doublex4() : v{0, 0, 0, 0} {}
+    doublex4(double s) : v{s, s, s, s} {} // NOLINT(google-explicit-constructor)
+    doublex4(double a, double b, double c, double d) : v{a, b, c, d} {}
+
+    static doublex4 load(const double* src) { return doublex4(src[0], src[1], src[2], src[3]); }
+    void store(double* dst) const { for (int i = 0; i < 4; i++) dst[i] = v[i]; }
+#endif
+
+    /**
+     * @param i Lane index
+     * @return Value of a single lane. Slow, meant for the scalar parts around vectorized code
+     */
+    double operator[](int i) const {
+        double lanes[4];
+        store(lanes);
+        return lanes[i];
+    }
+};
+
+struct maskx4 {
+#if defined(CPU_RAYMARCHER_SIMD_AVX)
+    __m256d v;
+
+    explicit maskx4(__m256d _v) : v(_v) {}
+    explicit maskx4(bool b) : v(_mm256_castsi256_pd(_mm256_set1_epi64x(b ? -1 : 0))) {}
+
+    /**
+     * @param bits Bit i is set if lane i is true
+     * @return Mask with the given lanes set
+     */
+    static maskx4 from_bits(int bits) {
+        return maskx4(_mm256_castsi256_pd(_mm256_setr_epi64x((bits & 1) ? -1 : 0, (bits & 2) ? -1 : 0,
+                                                             (bits & 4) ? -1 : 0, (bits & 8) ? -1 : 0)));
+    }
+
+    /**
+     * @return Bit i is set if lane i is true
+     */
+    int bits() const { return _mm256_movemask_pd(v); }
+#elif defined(CPU_RAYMARCHER_SIMD_SSE2)
+    __m128d lo, hi;
+
+    maskx4(__m128d _lo, __m128d _hi) : lo(_lo), hi(_hi) {}
+    explicit maskx4(bool b) : lo(_mm_castsi128_pd(_mm_set1_epi64x(b ? -1 : 0))), hi(lo) {}
+
+    static maskx4 from_bits(int bits) {
+        return maskx4(_mm_castsi128_pd(_mm_set_epi64x((bits & 2) ? -1 : 0, (bits & 1) ? -1 : 0)),
+                      _mm_castsi128_pd(_mm_set_epi64x((bits & 8) ? -1 : 0, (bits & 4) ? -1 : 0)));
+    }
+
+    int bits() const { return _mm_movemask_pd(lo) | (_mm_movemask_pd(hi) << 2); }
+#else
+    bool v[4];
+
+    maskx4(bool a, bool b, bool c, bool d) : v{a, b, c, d} {}
+    explicit maskx4(bool b) : v{b, b, b, b} {}
+
+    static maskx4 from_bits(int bits) { return maskx4(bits & 1, bits & 2, bits & 4, bits & 8); }
+
+    int bits() const { return (v[0] ? 1 : 0) | (v[1] ? 2 : 0) | (v[2] ? 4 : 0) | (v[3] ? 8 : 0); }
+#endif
+
+    bool any() const { return bits() != 0; }
+    bool all() const { return bits() == 0xF; }
+    bool lane(int i) const { return (bits() >> i) & 1; }
+};
+
+#if defined(CPU_RAYMARCHER_SIMD_AVX)
+
+inline doublex4 operator+(const doublex4& a, const doublex4& b) { return doublex4(_mm256_add_pd(a.v, b.v)); }
+inline doublex4 operator-(const doublex4& a, const doublex4& b) { return doublex4(_mm256_sub_pd(a.v, b.v)); }
+inline doublex4 operator*(const doublex4& a, const doublex4& b) { return doublex4(_mm256_mul_pd(a.v, b.v)); }
+inline doublex4 operator/(const doublex4& a, const doublex4& b) { return doublex4(_mm256_div_pd(a.v, b.v)); }
+inline doublex4 operator-(const doublex4& a) { return doublex4(_mm256_sub_pd(_mm256_setzero_pd(), a.v)); }
+inline doublex4 vmin(const doublex4& a, const doublex4& b) { return doublex4(_mm256_min_pd(a.v, b.v)); }
+inline doublex4 vmax(const doublex4& a, const doublex4& b) { return doublex4(_mm256_max_pd(a.v, b.v)); }
+inline doublex4 vsqrt(const doublex4& a) { return doublex4(_mm256_sqrt_pd(a.v)); }
+inline doublex4 vabs(const doublex4& a) { return doublex4(_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v)); }
+/**
+ * Rounds every lane to the nearest integer. Halfway cases may round either way, unlike std::round
+ */
+inline doublex4 vround(const doublex4& a) {
+    return doublex4(_mm256_round_pd(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+
+inline maskx4 operator<(const doublex4& a, const doublex4& b) { return maskx4(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)); }
+inline maskx4 operator<=(const doublex4& a, const doublex4& b) { return maskx4(_mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ)); }
+inline maskx4 operator>(const doublex4& a, const doublex4& b) { return maskx4(_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ)); }
+inline maskx4 operator>=(const doublex4& a, const doublex4& b) { return maskx4(_mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ)); }
+
+inline maskx4 operator&(const maskx4& a, const maskx4& b) { return maskx4(_mm256_and_pd(a.v, b.v)); }
+inline maskx4 operator|(const maskx4& a, const maskx4& b) { return maskx4(_mm256_or_pd(a.v, b.v)); }
+/**
+ * @return Lanes of a that are not set in b
+ */
+inline maskx4 andnot(const maskx4& a, const maskx4& b) { return maskx4(_mm256_andnot_pd(b.v, a.v)); }
+
+/**
+ * Lane-wise selection
+ * @return Lanes of a where m is true, lanes of b elsewhere
+ */
+inline doublex4 select(const maskx4& m, const doublex4& a, const doublex4& b) {
+    return doublex4(_mm256_blendv_pd(b.v, a.v, m.v));
+}
+
+#elif defined(CPU_RAYMARCHER_SIMD_SSE2)
+
+#define CPU_RAYMARCHER_SIMD_BINOP(_name, _intrin) \
+    inline doublex4 _name(const doublex4& a, const doublex4& b) { \
+        return doublex4(_intrin(a.lo, b.lo), _intrin(a.hi, b.hi)); }
+CPU_RAYMARCHER_SIMD_BINOP(operator+, _mm_add_pd)
+CPU_RAYMARCHER_SIMD_BINOP(operator-, _mm_sub_pd)
+CPU_RAYMARCHER_SIMD_BINOP(operator*, _mm_mul_pd)
+CPU_RAYMARCHER_SIMD_BINOP(operator/, _mm_div_pd)
+CPU_RAYMARCHER_SIMD_BINOP(vmin, _mm_min_pd)
+CPU_RAYMARCHER_SIMD_BINOP(vmax, _mm_max_pd)
+#undef CPU_RAYMARCHER_SIMD_BINOP
+
+inline doublex4 operator-(const doublex4& a) { return doublex4(0.0) - a; }
+inline doublex4 vsqrt(const doublex4& a) { return doublex4(_mm_sqrt_pd(a.lo), _mm_sqrt_pd(a.hi)); }
+inline doublex4 vabs(const doublex4& a) {
+    __m128d sign = _mm_set1_pd(-0.0);
+    return doublex4(_mm_andnot_pd(sign, a.lo), _mm_andnot_pd(sign, a.hi));
+}
+inline doublex4 vround(const doublex4& a) {
+    // SSE2 has no rounding instruction: adding and subtracting 2^52 drops the fraction bits of the magnitude.
+    // Magnitudes of at least 2^52 have no fraction bits and are passed through
+    __m128d sign = _mm_set1_pd(-0.0), magic = _mm_set1_pd(4503599627370496.0);
+    auto round2 = [&](__m128d x) {
+        __m128d mag = _mm_andnot_pd(sign, x);
+        __m128d rounded = _mm_sub_pd(_mm_add_pd(mag, magic), magic);
+        __m128d big = _mm_cmpge_pd(mag, magic);
+        rounded = _mm_or_pd(_mm_and_pd(big, mag), _mm_andnot_pd(big, rounded));
+        return _mm_or_pd(rounded, _mm_and_pd(sign, x));
+    };
+    return doublex4(round2(a.lo), round2(a.hi));
+}
+
+#define CPU_RAYMARCHER_SIMD_CMP(_name, _intrin) \
+    inline maskx4 _name(const doublex4& a, const doublex4& b) { \
+        return maskx4(_intrin(a.lo, b.lo), _intrin(a.hi, b.hi)); }
+CPU_RAYMARCHER_SIMD_CMP(operator<, _mm_cmplt_pd)
+CPU_RAYMARCHER_SIMD_CMP(operator<=, _mm_cmple_pd)
+CPU_RAYMARCHER_SIMD_CMP(operator>, _mm_cmpgt_pd)
+CPU_RAYMARCHER_SIMD_CMP(operator>=, _mm_cmpge_pd)
+#undef CPU_RAYMARCHER_SIMD_CMP
+
+inline maskx4 operator&(const maskx4& a, const maskx4& b) {
+    return maskx4(_mm_and_pd(a.lo, b.lo), _mm_and_pd(a.hi, b.hi));
+}
+inline maskx4 operator|(const maskx4& a, const maskx4& b) {
+    return maskx4(_mm_or_pd(a.lo, b.lo), _mm_or_pd(a.hi, b.hi));
+}
+inline maskx4 andnot(const maskx4& a, const maskx4& b) {
+    return maskx4(_mm_andnot_pd(b.lo, a.lo), _mm_andnot_pd(b.hi, a.hi));
+}
+
+inline doublex4 select(const maskx4& m, const doublex4& a, const doublex4& b) {
+    return doublex4(_mm_or_pd(_mm_and_pd(m.lo, a.lo), _mm_andnot_pd(m.lo, b.lo)),
+                    _mm_or_pd(_mm_and_pd(m.hi, a.hi), _mm_andnot_pd(m.hi, b.hi)));
+}
+
+#else
+
+#define CPU_RAYMARCHER_SIMD_BINOP(_name, _expr) \
+    inline doublex4 _name(const doublex4& a, const doublex4& b) { \
+        doublex4 r; for (int i = 0; i < 4; i++) r.v[i] = (_expr); return r; }
+CPU_RAYMARCHER_SIMD_BINOP(operator+, a.v[i] + b.v[i])
+CPU_RAYMARCHER_SIMD_BINOP(operator-, a.v[i] - b.v[i])
+CPU_RAYMARCHER_SIMD_BINOP(operator*, a.v[i] * b.v[i])
+CPU_RAYMARCHER_SIMD_BINOP(operator/, a.v[i] / b.v[i])
+CPU_RAYMARCHER_SIMD_BINOP(vmin, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+CPU_RAYMARCHER_SIMD_BINOP(vmax, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#undef CPU_RAYMARCHER_SIMD_BINOP
+
+inline doublex4 operator-(const doublex4& a) { return doublex4(0.0) - a; }
+inline doublex4 vsqrt(const doublex4& a) {
+    return doublex4(std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]));
+}
+inline doublex4 vabs(const doublex4& a) {
+    return doublex4(std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3]));
+}
+inline doublex4 vround(const doublex4& a) {
+    return doublex4(std::nearbyint(a.v[0]), std::nearbyint(a.v[1]), std::nearbyint(a.v[2]), std::nearbyint(a.v[3]));
+}
+
+#define CPU_RAYMARCHER_SIMD_CMP(_name, _op) \
+    inline maskx4 _name(const doublex4& a, const doublex4& b) { \
+        return maskx4(a.v[0] _op b.v[0], a.v[1] _op b.v[1], a.v[2] _op b.v[2], a.v[3] _op b.v[3]); }
+CPU_RAYMARCHER_SIMD_CMP(operator<, <)
+CPU_RAYMARCHER_SIMD_CMP(operator<=, <=)
+CPU_RAYMARCHER_SIMD_CMP(operator>, >)
+CPU_RAYMARCHER_SIMD_CMP(operator>=, >=)
+#undef CPU_RAYMARCHER_SIMD_CMP
+
+inline maskx4 operator&(const maskx4& a, const maskx4& b) {
+    return maskx4(a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3]);
+}
+inline maskx4 operator|(const maskx4& a, const maskx4& b) {
+    return maskx4(a.v[0] || b.v[0], a.v[1] || b.v[1], a.v[2] || b.v[2], a.v[3] || b.v[3]);
+}
+inline maskx4 andnot(const maskx4& a, const maskx4& b) {
+    return maskx4(a.v[0] && !b.v[0], a.v[1] && !b.v[1], a.v[2] && !b.v[2], a.v[3] && !b.v[3]);
+}
+
+inline doublex4 select(const maskx4& m, const doublex4& a, const doublex4& b) {
+    doublex4 r;
+    for (int i = 0; i < 4; i++) r.v[i] = m.v[i] ? a.v[i] : b.v[i];
+    return r;
+}
+
+#endif
+
+/**
+ * Lane-wise counterpart of std::atan2 for finite inputs, accurate to a few ulp. Built from the operations above, so
+ * every backend shares it
+ * @param y Second coordinates
+ * @param x First coordinates
+ * @return Angles of the points (x, y) in [-pi, pi]
+ */
+inline doublex4 vatan2(const doublex4& y, const doublex4& x) {
+    doublex4 ax = vabs(x), ay = vabs(y);
+    doublex4 hi = vmax(ax, ay);
+    // Reduce to atan(t) with t in [0, 1], then to |t| <= 0.66 through atan(t) = pi/4 + atan((t - 1) / (t + 1))
+    doublex4 t = select(hi > doublex4(0.0), vmin(ax, ay) / hi, doublex4(0.0));
+    maskx4 shifted = t > doublex4(0.66);
+    t = select(shifted, (t - doublex4(1.0)) / (t + doublex4(1.0)), t);
+
+    // Rational approximation of atan on the reduced range, coefficients from Cephes
+    doublex4 z = t * t;
+    doublex4 num = (((doublex4(-8.750608600031904122785e-1) * z - doublex4(1.615753718733365076637e1)) * z
+                     - doublex4(7.500855792314704667340e1)) * z - doublex4(1.228866684490136173410e2)) * z
+                   - doublex4(6.485021904942025371773e1);
+    doublex4 den = ((((z + doublex4(2.485846490142306297962e1)) * z + doublex4(1.650270098316988542046e2)) * z
+                     + doublex4(4.328810604912902668951e2)) * z + doublex4(4.853903996359136964868e2)) * z
+                   + doublex4(1.945506571482613964425e2);
+    doublex4 r = t + t * z * num / den;
+    r = select(shifted, r + doublex4(M_PI / 4), r);
+
+    // Undo the reduction to the first octant
+    r = select(ay > ax, doublex4(M_PI / 2) - r, r);
+    r = select(x < doublex4(0.0), doublex4(M_PI) - r, r);
+    return select(y < doublex4(0.0), -r, r);
+}
+
+#endif //CPU_RAYMARCHER_SIMD_H
@@ -0,0 +1,144 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "trace.h"
+
+std::atomic<bool> tracer::active {false};
+
+static const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+/**
+ * Ring buffer of the events of one thread
+ */
+struct trace_buffer {
+    explicit trace_buffer(int _tid) : tid(_tid) {}
+
+    int tid;
+    std::string name;
+    std::vector<trace_event> events;
+
+    /**
+     * Index the next event is written to once the buffer is full
+     */
+    size_t next = 0;
+    long dropped = 0;
+};
+
+static std::mutex registry_lock;
+static std::vector<std::shared_ptr<trace_buffer>> registry;
+
+/**
+ * @return Buffer of the calling thread, registered on first use. It outlives the thread
+ */
+static trace_buffer& local_buffer() {
+    thread_local std::shared_ptr<trace_buffer> buffer = []() {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        auto created = std::make_shared<trace_buffer>(static_cast<int>(registry.size()) + 1);
+        registry.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+void tracer::set_thread_name(const std::string& name) {
+    trace_buffer& buffer = local_buffer();
+    std::lock_guard<std::mutex> guard(registry_lock);
+    buffer.name = name;
+}
+
+std::uint64_t tracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+void tracer::record(const trace_event& event) {
+    trace_buffer& buffer = local_buffer();
+    if (buffer.events.size() < BUFFER_CAPACITY) {
+        buffer.events.push_back(event);
+        return;
+    }
+    buffer.events[buffer.next] = event;
+    buffer.next = (buffer.next + 1) % BUFFER_CAPACITY;
+    buffer.dropped++;
+}
+
+void tracer::reset() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    for (auto& buffer : registry) {
+        buffer->events.clear();
+        buffer->next = 0;
+        buffer->dropped = 0;
+    }
+}
+
+/**
+ * Writes a string as a JSON string literal
+ */
+static void write_json_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void tracer::write_json(std::ostream& out) {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    auto separator = [&]() {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    char number[64];
+    for (const auto& buffer : registry) {
+        if (!buffer->name.empty()) {
+            separator();
+            out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"args\": {\"name\": ";
+            write_json_string(out, buffer->name);
+            out << "}}";
+        }
+        if (buffer->dropped > 0) {
+            separator();
+            out << "{\"name\": \"dropped events\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"ts\": 0, \"args\": {\"count\": " << buffer->dropped << "}}";
+        }
+
+        // Oldest event first, the ring starts at 'next' once it has wrapped around
+        for (size_t i = 0; i < buffer->events.size(); i++) {
+            const trace_event& e = buffer->events[(buffer->next + i) % buffer->events.size()];
+            separator();
+            out << "{\"name\": ";
+            write_json_string(out, e.name);
+            out << ", \"cat\": ";
+            write_json_string(out, e.category);
+            std::snprintf(number, sizeof(number), "%.3f, \"dur\": %.3f", e.begin / 1e3, e.duration / 1e3);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid << ", \"ts\": " << number;
+            if (e.arg_names[0] != nullptr || e.arg_names[1] != nullptr) {
+                out << ", \"args\": {";
+                bool first_arg = true;
+                for (int a = 0; a < 2; a++) {
+                    if (e.arg_names[a] == nullptr) continue;
+                    if (!first_arg) out << ", ";
+                    write_json_string(out, e.arg_names[a]);
+                    out << ": " << e.args[a];
+                    first_arg = false;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
@@ -0,0 +1,126 @@
+#ifndef CPU_RAYMARCHER_TRACE_H
+#define CPU_RAYMARCHER_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * A span of time spent by one thread, e.g. on rendering a tile
+ */
+struct trace_event {
+    /**
+     * Name and category of the span. Must be string literals or otherwise outlive the tracer
+     */
+    const char* name;
+    const char* category;
+
+    /**
+     * Start and length of the span in nanoseconds since the start of the program
+     */
+    std::uint64_t begin;
+    std::uint64_t duration;
+
+    /**
+     * Up to two named integer arguments, unused if their name is nullptr
+     */
+    const char* arg_names[2];
+    long args[2];
+};
+
+/**
+ * Records the timeline of the render workers and the phases of the program for viewing in chrome://tracing or
+ * Perfetto. Every thread records its events into a ring buffer of its own, without synchronization, which keeps the
+ * most recent BUFFER_CAPACITY events. The buffers are only read by write_json, so no thread may record events while
+ * that runs. Recording is off by default
+ */
+class tracer {
+public:
+    /**
+     * Events kept per thread
+     */
+    static constexpr size_t BUFFER_CAPACITY = 1 << 16;
+
+    /**
+     * @return Whether events are currently recorded
+     */
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void set_enabled(bool on) { active.store(on, std::memory_order_relaxed); }
+
+    /**
+     * Names the calling thread in the timeline
+     */
+    static void set_thread_name(const std::string& name);
+
+    /**
+     * @return Nanoseconds since the start of the program
+     */
+    static std::uint64_t now();
+
+    /**
+     * Adds an event to the calling thread's buffer
+     */
+    static void record(const trace_event& event);
+
+    /**
+     * Discards all recorded events of all threads
+     */
+    static void reset();
+
+    /**
+     * Writes all recorded events in the Chrome trace event format, as one complete event ("ph": "X") per span and
+     * one metadata event per named thread
+     * @param out Output stream
+     */
+    static void write_json(std::ostream& out);
+
+private:
+    static std::atomic<bool> active;
+};
+
+/**
+ * Records the lifetime of the scope it is declared in as an event, if the tracer is enabled, see TRACE_SCOPE
+ */
+class trace_scope {
+public:
+    /**
+     * @param name Name of the span, a string literal
+     * @param category Category of the span, a string literal
+     * @param arg0_name Name of the first argument, nullptr for none
+     * @param arg0 Value of the first argument
+     * @param arg1_name Name of the second argument, nullptr for none
+     * @param arg1 Value of the second argument
+     */
+    explicit trace_scope(const char* name, const char* category = "render", const char* arg0_name = nullptr,
+                         long arg0 = 0, const char* arg1_name = nullptr, long arg1 = 0) {
+        if (!tracer::enabled()) return;
+        recording = true;
+        event = trace_event {name, category, tracer::now(), 0, {arg0_name, arg1_name}, {arg0, arg1}};
+    }
+
+    ~trace_scope() {
+        if (!recording) return;
+        event.duration = tracer::now() - event.begin;
+        tracer::record(event);
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+    bool recording = false;
+    trace_event event {};
+};
+
+#define TRACE_SCOPE_JOIN(a, b) a##b
+#define TRACE_SCOPE_NAME(line) TRACE_SCOPE_JOIN(trace_scope_guard_, line)
+
+/**
+ * Records the rest of the enclosing scope as a span, see trace_scope for the arguments
+ */
+#define TRACE_SCOPE(...) trace_scope TRACE_SCOPE_NAME(__LINE__)(__VA_ARGS__)
+
+#endif //CPU_RAYMARCHER_TRACE_H
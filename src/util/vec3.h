@@ -66,23 +66,35 @@ public:
      */
     double b() const { return e[2]; }
 
-    vec3 operator-() const;
-    double operator[](int i) const;
-    double& operator[](int i);
-
-    vec3& operator+=(const vec3 &v);
-    vec3& operator*=(double t);
-    vec3& operator/=(double t);
+    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
+    double operator[](int i) const { return e[i]; }
+    double& operator[](int i) { return e[i]; }
+
+    vec3& operator+=(const vec3 &v) {
+        e[0] += v.e[0];
+        e[1] += v.e[1];
+        e[2] += v.e[2];
+        return *this;
+    }
+
+    vec3& operator*=(const double t) {
+        e[0] *= t;
+        e[1] *= t;
+        e[2] *= t;
+        return *this;
+    }
+
+    vec3& operator/=(const double t) { return *this *= 1/t; }
 
     /**
      * @return Magnitude of the vector
      */
-    double length() const;
+    double length() const { return sqrt(length_squared()); }
 
     /**
      * @return Squared magnitude of the vector
      */
-    double length_squared() const;
+    double length_squared() const { return e[0] * e[0] + e[1] * e[1] + e[2] * e[2]; }
 private:
     double e[3];
 };
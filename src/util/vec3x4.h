@@ -0,0 +1,144 @@
+#ifndef CPU_RAYMARCHER_VEC3X4_H
+#define CPU_RAYMARCHER_VEC3X4_H
+
+#include "simd.h"
+#include "vec3.h"
+
+/**
+ * Four 3-component vectors stored as structure of arrays: one doublex4 per component. Counterpart of vec3 for
+ * evaluating four points with a single instruction per operation
+ */
+class vec3x4 {
+public:
+    static constexpr int WIDTH = doublex4::WIDTH;
+
+    /**
+     * Creates four zero-vectors
+     */
+    vec3x4() = default;
+
+    /**
+     * Creates four copies of the same vector
+     * @param v Vector stored in every lane
+     */
+    explicit vec3x4(const vec3& v) : ex(v.x()), ey(v.y()), ez(v.z()) {}
+
+    /**
+     * Creates vectors from given component lanes
+     * @param _x First components
+     * @param _y Second components
+     * @param _z Third components
+     */
+    vec3x4(const doublex4& _x, const doublex4& _y, const doublex4& _z) : ex(_x), ey(_y), ez(_z) {}
+
+    /**
+     * Creates vectors from four separate vectors
+     */
+    vec3x4(const vec3& a, const vec3& b, const vec3& c, const vec3& d)
+        : ex(a.x(), b.x(), c.x(), d.x()), ey(a.y(), b.y(), c.y(), d.y()), ez(a.z(), b.z(), c.z(), d.z()) {}
+
+    const doublex4& x() const { return ex; }
+    const doublex4& y() const { return ey; }
+    const doublex4& z() const { return ez; }
+
+    /**
+     * @param i Lane index
+     * @return Vector of a single lane
+     */
+    vec3 lane(int i) const { return vec3(ex[i], ey[i], ez[i]); }
+
+    /**
+     * @return Magnitudes of the vectors
+     */
+    doublex4 length() const { return vsqrt(length_squared()); }
+
+    /**
+     * @return Squared magnitudes of the vectors
+     */
+    doublex4 length_squared() const { return ex * ex + ey * ey + ez * ez; }
+
+private:
+    doublex4 ex, ey, ez;
+};
+
+inline vec3x4 operator+(const vec3x4& u, const vec3x4& v) {
+    return vec3x4(u.x() + v.x(), u.y() + v.y(), u.z() + v.z());
+}
+
+inline vec3x4 operator-(const vec3x4& u, const vec3x4& v) {
+    return vec3x4(u.x() - v.x(), u.y() - v.y(), u.z() - v.z());
+}
+
+inline vec3x4 operator-(const vec3x4& u, const vec3& v) {
+    return vec3x4(u.x() - doublex4(v.x()), u.y() - doublex4(v.y()), u.z() - doublex4(v.z()));
+}
+
+inline vec3x4 operator+(const vec3x4& u, const vec3& v) {
+    return vec3x4(u.x() + doublex4(v.x()), u.y() + doublex4(v.y()), u.z() + doublex4(v.z()));
+}
+
+inline vec3x4 operator*(const vec3x4& u, const vec3x4& v) {
+    return vec3x4(u.x() * v.x(), u.y() * v.y(), u.z() * v.z());
+}
+
+inline vec3x4 operator*(const doublex4& t, const vec3x4& v) {
+    return vec3x4(t * v.x(), t * v.y(), t * v.z());
+}
+
+inline vec3x4 operator*(const doublex4& t, const vec3& v) {
+    return vec3x4(t * doublex4(v.x()), t * doublex4(v.y()), t * doublex4(v.z()));
+}
+
+/**
+ * Calculates the lane-wise dot products of two vector packs
+ */
+inline doublex4 dot(const vec3x4& u, const vec3x4& v) {
+    return u.x() * v.x()
+           + u.y() * v.y()
+           + u.z() * v.z();
+}
+
+/**
+ * Calculates the lane-wise dot products of a vector pack with a single vector
+ */
+inline doublex4 dot(const vec3x4& u, const vec3& v) {
+    return u.x() * doublex4(v.x())
+           + u.y() * doublex4(v.y())
+           + u.z() * doublex4(v.z());
+}
+
+/**
+ * Calculates the lane-wise cross products of two vector packs
+ */
+inline vec3x4 cross(const vec3x4& u, const vec3x4& v) {
+    return vec3x4(u.y() * v.z() - u.z() * v.y(),
+                  u.z() * v.x() - u.x() * v.z(),
+                  u.x() * v.y() - u.y() * v.x());
+}
+
+/**
+ * Component-wise minimum of two vector packs
+ */
+inline vec3x4 vmin(const vec3x4& u, const vec3x4& v) {
+    return vec3x4(vmin(u.x(), v.x()), vmin(u.y(), v.y()), vmin(u.z(), v.z()));
+}
+
+/**
+ * Component-wise maximum of two vector packs
+ */
+inline vec3x4 vmax(const vec3x4& u, const vec3x4& v) {
+    return vec3x4(vmax(u.x(), v.x()), vmax(u.y(), v.y()), vmax(u.z(), v.z()));
+}
+
+/**
+ * Clamps every lane to a given range
+ * @param t The values
+ * @param lower Lower bounds of the range
+ * @param upper Upper bounds of the range
+ * @return Clamped values
+ */
+inline doublex4 vclamp(const doublex4& t, const doublex4& lower, const doublex4& upper) {
+    return vmin(vmax(lower, t), upper);
+}
+
+#endif //CPU_RAYMARCHER_VEC3X4_H